@@ -0,0 +1,277 @@
+// malloc_shim.c
+// Description: LD_PRELOAD library exporting the malloc family on top of
+//              setup, my_malloc and my_free over an mmap reserved region
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define  DEFAULT_ARENA    (1 << 30)
+#define  MIN_ALIGN        16
+#define  EXPORT           __attribute__((visibility("default")))
+
+extern void setup(int malloc_type, int mem_size, void* start_of_memory);
+extern void *my_malloc(int size);
+extern void my_free(void *ptr);
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+/**
+* Data Structures
+*/
+
+// Prefix stored right before every pointer handed out
+//  base - Pointer returned by my_malloc, passed back to my_free
+//  size - Usable bytes after the prefix
+typedef struct {
+    void *base;
+    size_t size;
+} ShimPrefix;
+
+/**
+* Global Variables
+*/
+
+pthread_mutex_t shimLock = PTHREAD_MUTEX_INITIALIZER;
+char *arenaStart = NULL;
+char *arenaEnd = NULL;
+int arenaReady = 0;
+unsigned long fallbacks = 0;
+size_t (*libcUsableSize)(void *) = NULL;
+
+// Set while a thread is inside the allocator, nested calls (the allocator
+// keeps its bookkeeping in its own node pools, so only stray library calls
+// such as stdio) are served by glibc
+static __thread int inAllocator __attribute__((tls_model("initial-exec")));
+
+/**
+* Helper Functions
+*/
+
+/**
+* Owns
+* * Checks if the pointer was handed out from the managed arena
+* @param ptr pointer to check
+* @return non-zero if ptr lies in the arena
+*/
+static inline int owns(void *ptr) {
+    return (char *)ptr >= arenaStart && (char *)ptr < arenaEnd;
+}
+
+/**
+* Prefix Of
+* * Fetches the prefix of a pointer handed out by the shim
+* @param ptr pointer returned by the shim
+* @return pointer to the prefix of ptr
+*/
+static inline ShimPrefix *prefixOf(void *ptr) {
+    return (ShimPrefix *)ptr - 1;
+}
+
+/**
+* Fork Handlers
+* * Hold the allocator lock across fork so the child never inherits it mid update
+*/
+static void forkPrepare(void) {
+    pthread_mutex_lock(&shimLock);
+}
+
+static void forkRelease(void) {
+    pthread_mutex_unlock(&shimLock);
+}
+
+/**
+* Shim Init
+* * Reserves the arena and runs setup, caller must hold shimLock
+* * MYMALLOC_TYPE selects 0 - Buddy or 1 - Slab, MYMALLOC_ARENA the arena size in bytes
+*/
+static void shimInit(void) {
+    arenaReady = -1;
+
+    const char *typeEnv = getenv("MYMALLOC_TYPE");
+    const char *arenaEnv = getenv("MYMALLOC_ARENA");
+    int type = typeEnv != NULL ? atoi(typeEnv) : 0;
+    long arenaSize = arenaEnv != NULL ? atol(arenaEnv) : DEFAULT_ARENA;
+
+    // The buddy allocator splits a power of two region, my_malloc sizes are int
+    if (arenaSize > DEFAULT_ARENA || arenaSize < 1024) arenaSize = DEFAULT_ARENA;
+    long powerSize = 1024;
+    while (powerSize * 2 <= arenaSize) powerSize *= 2;
+
+    void *arena = mmap(NULL, powerSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED) return;
+
+    libcUsableSize = (size_t (*)(void *))dlsym(RTLD_NEXT, "malloc_usable_size");
+    setup(type, (int)powerSize, arena);
+    pthread_atfork(forkPrepare, forkRelease, forkRelease);
+
+    arenaStart = arena;
+    arenaEnd = arenaStart + powerSize;
+    arenaReady = 1;
+}
+
+/**
+* Shim Alloc
+* * Allocates an aligned block from the arena, falling back to glibc when it is exhausted
+* @param alignment power of two alignment of the returned pointer
+* @param size bytes requested
+* @return pointer to the block, NULL if no allocator could satisfy it
+*/
+static void *shimAlloc(size_t alignment, size_t size) {
+    if (inAllocator) return __libc_memalign(alignment, size);
+    if (alignment < MIN_ALIGN) alignment = MIN_ALIGN;
+
+    // Sizes no arena can hold go to glibc before the rounding below can wrap around
+    int fits = size <= DEFAULT_ARENA && alignment <= DEFAULT_ARENA;
+
+    // Round to 16 byte classes so the slab table only sees a few sizes
+    size_t usable = fits ? (size + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1) : 0;
+    size_t request = usable + sizeof(ShimPrefix) + alignment;
+
+    void *ptr = NULL;
+    pthread_mutex_lock(&shimLock);
+    inAllocator = 1;
+    if (arenaReady == 0) shimInit();
+    if (fits && arenaReady == 1 && request < (size_t)(arenaEnd - arenaStart)) {
+        void *base = my_malloc((int)request);
+        if (base != NULL && base != (void *)-1) {
+            uintptr_t aligned = ((uintptr_t)base + sizeof(ShimPrefix) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+            ptr = (void *)aligned;
+            prefixOf(ptr)->base = base;
+            prefixOf(ptr)->size = usable;
+        }
+    }
+    if (ptr == NULL) fallbacks++;
+    inAllocator = 0;
+    pthread_mutex_unlock(&shimLock);
+
+    if (ptr == NULL) {
+        ptr = __libc_memalign(alignment, size);
+        if (ptr == NULL) errno = ENOMEM;
+    }
+    return ptr;
+}
+
+/**
+* Shim Free
+* * Returns an arena block to my_free, anything else to glibc
+* @param ptr pointer to release
+*/
+static void shimFree(void *ptr) {
+    if (ptr == NULL) return;
+    if (!owns(ptr)) {
+        __libc_free(ptr);
+        return;
+    }
+
+    pthread_mutex_lock(&shimLock);
+    inAllocator = 1;
+    my_free(prefixOf(ptr)->base);
+    inAllocator = 0;
+    pthread_mutex_unlock(&shimLock);
+}
+
+/**
+* Usable Size
+* * Bytes usable behind a pointer from either allocator
+* @param ptr pointer to inspect
+* @return usable size, 0 for NULL
+*/
+static size_t usableSize(void *ptr) {
+    if (ptr == NULL) return 0;
+    if (owns(ptr)) return prefixOf(ptr)->size;
+    return libcUsableSize != NULL ? libcUsableSize(ptr) : 0;
+}
+
+__attribute__((destructor)) static void shimFini(void) {
+    if (getenv("MYMALLOC_STATS") != NULL) {
+        fprintf(stderr, "mymalloc: arena %ld bytes, %lu allocations served by glibc\n",
+            (long)(arenaEnd - arenaStart), fallbacks);
+    }
+}
+
+/**
+* Main Functions
+*/
+
+EXPORT void *malloc(size_t size) {
+    return shimAlloc(MIN_ALIGN, size);
+}
+
+EXPORT void free(void *ptr) {
+    shimFree(ptr);
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size) {
+    if (inAllocator) return __libc_calloc(nmemb, size);
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    void *ptr = shimAlloc(MIN_ALIGN, nmemb * size);
+    if (ptr != NULL) memset(ptr, 0, nmemb * size);
+    return ptr;
+}
+
+EXPORT void *realloc(void *ptr, size_t size) {
+    if (inAllocator || (ptr != NULL && !owns(ptr))) return __libc_realloc(ptr, size);
+    if (ptr == NULL) return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+
+    // Shrinking or growing inside the size class keeps the block
+    size_t oldSize = prefixOf(ptr)->size;
+    if (size <= oldSize) return ptr;
+
+    void *newPtr = malloc(size);
+    if (newPtr == NULL) return NULL;
+    memcpy(newPtr, ptr, oldSize);
+    free(ptr);
+    return newPtr;
+}
+
+EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment % sizeof(void *) != 0) return EINVAL;
+    void *ptr = shimAlloc(alignment, size);
+    if (ptr == NULL) return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+EXPORT void *memalign(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return shimAlloc(alignment, size);
+}
+
+EXPORT void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+EXPORT void *valloc(size_t size) {
+    return shimAlloc(sysconf(_SC_PAGESIZE), size);
+}
+
+EXPORT void *pvalloc(size_t size) {
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    return shimAlloc(pageSize, (size + pageSize - 1) & ~(pageSize - 1));
+}
+
+EXPORT size_t malloc_usable_size(void *ptr) {
+    return usableSize(ptr);
+}
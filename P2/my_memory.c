@@ -1,16 +1,37 @@
 // Include files
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "my_memory.h"
 #define  N_OBJS_PER_SLAB  64
+#define  CACHE_LINE       64
 #define  minSize          1024
 #define  BUDDY            0
 #define  SLAB             1
 #define  ULONG_MAX        0xFFFFFFFFFFFFFFFF
+#define  POOL_CHUNK       65536
+#define  HEADER_SIZE      ((int)sizeof(Header))
+#define  OBJ_OVERHEAD     (HEADER_SIZE+REDZONE_SIZE)
 
-// Functional prototypes
-void setup(int malloc_type, int mem_size, void* start_of_memory);
-void *my_malloc(int size);
-void my_free(void *ptr);
+// Hardened build, compile with -DMM_HARDEN
+//  Every object header carries a tag marking it allocated or free
+//  Every object is followed by a redzone filled with REDZONE_BYTE
+//  One in QUARANTINE_RATE frees has its first POISON_SIZE bytes poisoned and is held back
+//  for QUARANTINE_SIZE sampled frees
+#ifdef MM_HARDEN
+#define  REDZONE_SIZE     8
+#define  REDZONE_BYTE     0xAB
+#define  POISON_BYTE      0xDD
+#define  ALLOC_TAG        0xA110CA7E
+#define  FREE_TAG         0xF4EEF4EE
+#define  SLAB_TAG         0x51AB51AB
+#define  QUARANTINE_SIZE  64
+#define  QUARANTINE_RATE  16
+#define  POISON_SIZE      128
+#else
+#define  REDZONE_SIZE     0
+#endif
 
 /**
 * Data Structures
@@ -20,11 +41,13 @@ void my_free(void *ptr);
 typedef enum {false, true} bool;
 
 // Header
-//  Chunk size
-//  Chunk allocated boolean
-//  Previous chunk allocated boolean
+//  Chunk size, including the redzone of an object
+//  Free state tag, hardened build only
 typedef struct Header {
     unsigned int size : 32;
+#ifdef MM_HARDEN
+    unsigned int tag : 32;
+#endif
 } Header;
 
 // AvailableHole
@@ -33,6 +56,7 @@ typedef struct Header {
 //  Pointer to next hole
 //  Size of available hole
 //    Serves as bitmap in slab
+//  Color offset of the first object, only used by slabs
 typedef struct AvailableHole AvailableHole;
 
 struct AvailableHole {
@@ -40,6 +64,7 @@ struct AvailableHole {
     void *end;
     AvailableHole *next;
     unsigned long size : 64;
+    unsigned int color;
 };
 
 // Slab Descriptor for table
@@ -47,14 +72,39 @@ struct AvailableHole {
 //  Allocated size for slab
 //  Total items that can be stored in slab
 //  Slab pointer info
-typedef struct {
+//  Cache name, NULL for the anonymous entries of my_malloc
+//  Objects per slab, at most 64 for the bitmap
+//  Color of the next slab and largest color that fits in a slab
+//  Object constructor and destructor, may be NULL
+typedef struct SlabDescriptor {
     unsigned int itemSize;
     unsigned int allocSize;
     unsigned int total;
     unsigned int used;
     AvailableHole *slabPtr;
+    const char *name;
+    unsigned int objsPerSlab;
+    unsigned int colorNext;
+    unsigned int colorMax;
+    void (*ctor)(void *);
+    void (*dtor)(void *);
 } SlabDescriptor;
 
+// Pool Node
+//  Free node of a NodePool, overlays the node while it is free
+typedef struct PoolNode {
+    struct PoolNode *next;
+} PoolNode;
+
+// Node Pool
+//  Fixed size allocator for the allocator's own bookkeeping nodes
+//  Size of each node
+//  List of free nodes, refilled one mmap chunk at a time
+typedef struct {
+    size_t nodeSize;
+    PoolNode *freeList;
+} NodePool;
+
 // Allocator variables
 int allocType = -1;
 int maxMem = -1;
@@ -62,13 +112,72 @@ void *allMem;
 
 int maxAvailableHoles = 0;
 int slabItems = 0;
+int slabObjects = N_OBJS_PER_SLAB;
 AvailableHole **holeList;
 SlabDescriptor **descriptorTable;
+int descriptorCapacity = 0;
+
+NodePool holePool = {sizeof(AvailableHole), NULL};
+// One hole node for every allocated buddy chunk, so freeing a chunk never needs a new node
+NodePool reservePool = {sizeof(AvailableHole), NULL};
+NodePool descriptorPool = {sizeof(SlabDescriptor), NULL};
+
+#ifdef MM_HARDEN
+Header *quarantine[QUARANTINE_SIZE];
+int quarantineNext = 0;
+int quarantineCount = 0;
+unsigned long freeCount = 0;
+#endif
 
 /**
 * Helper Functions
 */
 
+/**
+* Map Array
+* * Maps zeroed memory for a bookkeeping array straight from the system
+* @param bytes size of the array
+* @return pointer to the array, NULL if it can't be mapped
+*/
+void *mapArray(size_t bytes) {
+    void *array = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return array == MAP_FAILED ? NULL : array;
+}
+
+/**
+* Pool Alloc
+* * Takes a node from the pool, mapping a new chunk of nodes when it is empty
+* @param pool pool to allocate from
+* @return pointer to the node, NULL if no chunk can be mapped
+*/
+void *poolAlloc(NodePool *pool) {
+    if (pool->freeList == NULL) {
+        char *chunk = mapArray(POOL_CHUNK);
+        if (chunk == NULL) return NULL;
+        // Push in reverse so nodes are handed out in ascending address order
+        for (size_t offset = POOL_CHUNK/pool->nodeSize*pool->nodeSize; offset > 0; offset -= pool->nodeSize) {
+            PoolNode *node = (PoolNode *)(chunk+offset-pool->nodeSize);
+            node->next = pool->freeList;
+            pool->freeList = node;
+        }
+    }
+    PoolNode *node = pool->freeList;
+    pool->freeList = node->next;
+    return node;
+}
+
+/**
+* Pool Free
+* * Returns a node to the pool
+* @param pool pool the node was taken from
+* @param ptr node to return
+*/
+void poolFree(NodePool *pool, void *ptr) {
+    PoolNode *node = ptr;
+    node->next = pool->freeList;
+    pool->freeList = node;
+}
+
 /**
 * Fetch Header
 * * Fetches the header of the provided pointer
@@ -114,13 +223,14 @@ int convertIndex(unsigned int index) {
 /**
 * Find Descriptor Index
 * * Finds the index of the size in the descriptorTable
+* * Named caches are skipped, they are only reached through their handle
 * @param size size whos index is to be found
 * @return index in desciptor table
 */
 int findDescriptorIndex(int size) {
     int index = -1;
     for (int i = 0; i < slabItems; i++) {
-        if (size == descriptorTable[i]->itemSize) {
+        if (descriptorTable[i]->name == NULL && size == descriptorTable[i]->itemSize) {
             index = i;
             break;
         }
@@ -137,9 +247,10 @@ int findDescriptorIndex(int size) {
 void *buddyAllocate(int size) {
     void *retVal = (void *)-1;
 
-    // Include +4 for the header
-    int log2size = convertSize(size+4);
+    // Include the header
+    int log2size = convertSize(size+HEADER_SIZE);
     int i = log2size;
+    if (log2size > maxAvailableHoles - 1) return retVal;
 
     // Iterate through hole list and find lowest 
     // available hole to accomodate needed size
@@ -148,6 +259,10 @@ void *buddyAllocate(int size) {
 
     // Begin recursively breaking hole in two
     while (holeList[log2size] == NULL) {
+        // Take the node for the hole left behind first, the lists are consistent after every split
+        AvailableHole *newHole = poolAlloc(&holePool);
+        if (newHole == NULL) return retVal;
+
         // Copy hole
         AvailableHole *hole = holeList[i];
 
@@ -157,7 +272,6 @@ void *buddyAllocate(int size) {
 
         // Prep newHole, the hole that is left behind
         int newSize = (hole->size)/2;
-        AvailableHole *newHole = malloc(sizeof(AvailableHole));
         newHole->start = (char *)(hole->start)+newSize;
         newHole->end = hole->end;
         newHole->size = newSize;
@@ -202,8 +316,8 @@ void *buddyAllocate(int size) {
     void *start = newHole->start;
     // Set the hole list to point at the next hole
     holeList[log2size] = newHole->next;
-    // Free the temporary memory
-    free(newHole);
+    // Keep its node in reserve for the free of the chunk
+    poolFree(&reservePool, newHole);
     // Return the start address for the memory chunk
     return start;
 }
@@ -216,128 +330,415 @@ void *buddyAllocate(int size) {
 void buddyDeallocate(void *ptr) {
     Header *header = fetchHeader(ptr);
     // Calculate index and chunk size of allocated block
-    int log2size = convertSize((header->size)+4);
+    int log2size = convertSize((header->size)+HEADER_SIZE);
     int chunkSize = convertIndex(log2size);
     
-    // Calculate the new available hole being added
-    AvailableHole *newHole = malloc(sizeof(AvailableHole));
+    // Calculate the new available hole being added, from the node the chunk holds in reserve
+    AvailableHole *newHole = poolAlloc(&reservePool);
+    // Only a free of a chunk that was never allocated can find the reserve empty and unmappable
+    if (newHole == NULL) return;
     newHole->start = (char *)(ptr);
     newHole->end = (char *)(ptr)+chunkSize-1;
     newHole->size = chunkSize;
     newHole->next = NULL;
 
-    // Check if we need to check for buddy merge
-    AvailableHole *thisHole = holeList[log2size];
-    while (thisHole != NULL) {
-        // Check if this is a first or second hole in the holes list
+    // Merge with the buddy hole while it is free, moving up one size each time
+    while (log2size < maxAvailableHoles - 1) {
+        // Check if this is a first or second hole to locate its buddy
         bool firstHole = 1 - ((((char *)(newHole->start) - (char *)allMem) / newHole->size) % 2);
-        bool buddyFound = false;
+        char *buddyStart = firstHole ? (char *)(newHole->end)+1 : (char *)(newHole->start)-newHole->size;
+
+        // Search the list of this size for the buddy
+        AvailableHole *prevHole = NULL;
+        AvailableHole *thisHole = holeList[log2size];
+        while (thisHole != NULL && (char *)(thisHole->start) < buddyStart) {
+            prevHole = thisHole;
+            thisHole = thisHole->next;
+        }
+        if (thisHole == NULL || thisHole->start != buddyStart) break;
+
+        // Do some buddy merging
+        if (prevHole == NULL) {
+            holeList[log2size] = thisHole->next;
+        } else {
+            prevHole->next = thisHole->next;
+        }
         if (firstHole) {
-            AvailableHole *nextHole = thisHole->next;
-
-            // If the first hole in the list is this holes buddy
-            if (thisHole->start == (char *)(newHole->end)+1) {
-                newHole->end = thisHole->end;
-                newHole->size = 2*newHole->size;
-                holeList[log2size] = nextHole;
-                free(thisHole);
-                buddyFound = true;
-            }
+            newHole->end = thisHole->end;
+        } else {
+            newHole->start = thisHole->start;
+        }
+        newHole->size = 2*newHole->size;
+        poolFree(&holePool, thisHole);
+        log2size++;
+    }
 
-            // Iterate through the list to find the holes buddy
-            while (!buddyFound && nextHole != NULL && (char *)(newHole->end) < (char *)(nextHole->start)) {
-                if (nextHole->start == (char *)(newHole->end)+1) {
-                    // Do some buddy merging
-                    buddyFound = true;
-                    newHole->end = nextHole->end;
-                    newHole->size = 2*newHole->size;
-                    thisHole->next = nextHole->next;
-                    free(nextHole);
-                    break;
-                }
-                thisHole = nextHole;
-                nextHole = thisHole->next;
-            }
+    // Insert the hole in accordance to memory address
+    AvailableHole *prevHole = NULL;
+    AvailableHole *thisHole = holeList[log2size];
+    while (thisHole != NULL && thisHole->start < newHole->start) {
+        prevHole = thisHole;
+        thisHole = thisHole->next;
+    }
+    newHole->next = thisHole;
+    if (prevHole == NULL) {
+        holeList[log2size] = newHole;
+    } else {
+        prevHole->next = newHole;
+    }
+}
 
-            // Check finish criteria for list interation
-            if (buddyFound) {
-                thisHole = holeList[++log2size];
-            } else {
-                // If there is no nextHole and thisHole is not the buddy
-                if (nextHole == NULL) {
-                    if ((char *)thisHole->start < (char *)(newHole->start)) {
-                        thisHole->next = newHole;
-                        return;
-                    } else {
-                        newHole->next = thisHole;
-                        holeList[log2size] = newHole;
-                        return;
-                    }
-                }
-                // The buddy is not in the list and we are now out of order
-                if (newHole->end > nextHole->start) {
-                    newHole->next = nextHole->next;
-                    nextHole->next = newHole;
-                    return;
-                }
-            }
-        } else { // Is a second hole
-            AvailableHole *nextHole = thisHole->next;
-
-            // If the first hole in the list is this holes buddy
-            if (thisHole->end == (char *)(newHole->start)-1) {
-                newHole->start = thisHole->start;
-                newHole->size = 2*newHole->size;
-                holeList[log2size] = nextHole;
-                free(thisHole);
-                buddyFound = true;
-            }
+#ifdef MM_HARDEN
+/**
+* Heap Error
+* * Reports heap corruption and aborts
+* @param what description of the corruption
+* @param ptr chunk or object header where it was found
+*/
+void heapError(const char *what, void *ptr) {
+    fprintf(stderr, "my_memory: %s at offset %ld\n", what, (long)((char *)ptr - (char *)allMem));
+    abort();
+}
+
+/**
+* Redzone Of
+* * Finds the redzone following an object
+* @param header header of the object
+* @return pointer to the first redzone byte
+*/
+unsigned char *redzoneOf(Header *header) {
+    return (unsigned char *)(header) + HEADER_SIZE + header->size - REDZONE_SIZE;
+}
+
+/**
+* Arm Object
+* * Tags a newly allocated object and fills its redzone
+* @param header header of the object
+*/
+void armObject(Header *header) {
+    header->tag = ALLOC_TAG;
+    memset(redzoneOf(header), REDZONE_BYTE, REDZONE_SIZE);
+}
+
+/**
+* Redzone Intact
+* * Checks that nothing wrote past the end of an object
+* @param header header of the object
+* @return true if every redzone byte still holds REDZONE_BYTE
+*/
+bool redzoneIntact(Header *header) {
+    static unsigned char pattern[REDZONE_SIZE] = {[0 ... REDZONE_SIZE-1] = REDZONE_BYTE};
+    return memcmp(redzoneOf(header), pattern, REDZONE_SIZE) == 0;
+}
+
+/**
+* Check Object
+* * Validates an object about to be freed, aborting on a bad pointer, double free or overflow
+* @param ptr header of the object
+* @param buddyObject whether the object is a whole buddy chunk rather than a slab object
+*/
+void checkObject(void *ptr, bool buddyObject) {
+    Header *header = fetchHeader(ptr);
+    if ((char *)ptr < (char *)allMem || (char *)ptr + HEADER_SIZE > (char *)allMem + maxMem) heapError("free of pointer outside memory", ptr);
+    if (header->tag == FREE_TAG) heapError("double free", ptr);
+    if (header->tag != ALLOC_TAG) heapError("free of invalid pointer or corrupted header", ptr);
+    if (header->size < REDZONE_SIZE || (char *)ptr + HEADER_SIZE + header->size > (char *)allMem + maxMem) heapError("corrupted header size", ptr);
+    if (!redzoneIntact(header)) heapError("heap overflow past end of object", ptr);
+    if (buddyObject && ((char *)ptr - (char *)allMem) % minSize != 0) heapError("free of pointer not at the start of a chunk", ptr);
+}
+
+/**
+* In Quarantine
+* * Checks if a freed object is still held in quarantine
+* @param header header of the object
+* @return true if the object is in quarantine
+*/
+bool inQuarantine(Header *header) {
+    for (int i = 0; i < quarantineCount; i++) {
+        if (quarantine[i] == header) return true;
+    }
+    return false;
+}
+
+/**
+* Quarantine Object
+* * Poisons a freed object and holds it back, releasing the oldest held object once full
+* @param header header of the freed object
+* @return header of the object to really free, NULL if none
+*/
+Header *quarantineObject(Header *header) {
+    static unsigned char poison[POISON_SIZE] = {[0 ... POISON_SIZE-1] = POISON_BYTE};
+    unsigned int poisonSize = header->size - REDZONE_SIZE;
+    if (poisonSize > POISON_SIZE) poisonSize = POISON_SIZE;
+    memcpy((char *)(header)+HEADER_SIZE, poison, poisonSize);
+    if (quarantineCount < QUARANTINE_SIZE) {
+        quarantine[quarantineCount++] = header;
+        return NULL;
+    }
+
+    // Anything but poison in the oldest object means it was written after free
+    Header *oldest = quarantine[quarantineNext];
+    poisonSize = oldest->size - REDZONE_SIZE;
+    if (poisonSize > POISON_SIZE) poisonSize = POISON_SIZE;
+    if (memcmp((char *)(oldest)+HEADER_SIZE, poison, poisonSize) != 0) heapError("use after free write", oldest);
+    quarantine[quarantineNext] = header;
+    quarantineNext = (quarantineNext + 1) % QUARANTINE_SIZE;
+    return oldest;
+}
+#endif
+
+/**
+* Slab Mask
+* * Bitmap of a slab with every object in use
+* @param objs number of objects in the slab
+* @return bitmap with the top objs bits set
+*/
+unsigned long slabMask(unsigned int objs) {
+    if (objs >= 64) return ULONG_MAX;
+    return (((unsigned long)1 << objs) - 1) << (64 - objs);
+}
+
+/**
+* Slab Object
+* * Finds the header of an object within a slab
+* @param desc descriptor of the slab
+* @param slab slab holding the object
+* @param index index of the object within the slab
+* @return pointer to the header of the object
+*/
+char *slabObject(SlabDescriptor *desc, AvailableHole *slab, int index) {
+    return (char *)(slab->start)+HEADER_SIZE + slab->color + index*(desc->itemSize+OBJ_OVERHEAD);
+}
+
+/**
+* Create Descriptor
+* * Adds a new entry without slabs to the descriptorTable
+* @param name cache name, NULL for an anonymous my_malloc entry
+* @param size size of the items in the slabs
+* @param objs objects per slab
+* @param ctor object constructor, may be NULL
+* @param dtor object destructor, may be NULL
+* @param colored whether consecutive slabs get different color offsets
+* @return pointer to the new descriptor, NULL if its bookkeeping can't be mapped
+*/
+SlabDescriptor *createDescriptor(const char *name, int size, int objs, void (*ctor)(void *), void (*dtor)(void *), bool colored) {
+    // Grow the table geometrically, it never shrinks
+    if (slabItems == descriptorCapacity) {
+        int newCapacity = descriptorCapacity ? 2*descriptorCapacity : 64;
+        SlabDescriptor **newTable = mapArray(newCapacity*sizeof(SlabDescriptor *));
+        if (newTable == NULL) return NULL;
+        if (descriptorTable != NULL) {
+            memcpy(newTable, descriptorTable, slabItems*sizeof(SlabDescriptor *));
+            munmap(descriptorTable, descriptorCapacity*sizeof(SlabDescriptor *));
+        }
+        descriptorTable = newTable;
+        descriptorCapacity = newCapacity;
+    }
+
+    SlabDescriptor *newSlabDescriptor = poolAlloc(&descriptorPool);
+    if (newSlabDescriptor == NULL) return NULL;
+    newSlabDescriptor->itemSize = size;
+    newSlabDescriptor->allocSize = convertIndex(convertSize(objs*(size+OBJ_OVERHEAD)+HEADER_SIZE));
+    newSlabDescriptor->total = 0;
+    newSlabDescriptor->used = 0;
+    newSlabDescriptor->slabPtr = NULL;
+    newSlabDescriptor->name = name;
+    newSlabDescriptor->objsPerSlab = objs;
+    newSlabDescriptor->ctor = ctor;
+    newSlabDescriptor->dtor = dtor;
+
+    // Colors step by a cache line through the space the objects leave unused
+    newSlabDescriptor->colorNext = 0;
+    newSlabDescriptor->colorMax = 0;
+    if (colored) {
+        newSlabDescriptor->colorMax = (newSlabDescriptor->allocSize - HEADER_SIZE - objs*(size+OBJ_OVERHEAD)) / CACHE_LINE * CACHE_LINE;
+    }
+
+    descriptorTable[slabItems++] = newSlabDescriptor;
+    return newSlabDescriptor;
+}
+
+/**
+* Remove Descriptor
+* * Removes an entry from the descriptorTable and frees it
+* @param desc descriptor to remove
+*/
+void removeDescriptor(SlabDescriptor *desc) {
+    int tableIndex = 0;
+    while (tableIndex < slabItems && descriptorTable[tableIndex] != desc) tableIndex++;
+    if (tableIndex == slabItems) return;
+
+    // Swap end of table to current position
+    SlabDescriptor *tempDescriptor = descriptorTable[--slabItems];
+    poolFree(&descriptorPool, descriptorTable[tableIndex]);
+    descriptorTable[tableIndex] = tempDescriptor;
+}
+
+/**
+* Create Slab
+* * Allocates a new empty slab for the descriptor with the buddy allocator
+* @param desc descriptor the slab belongs to
+* @return pointer to the slab entry, NULL if memory is exhausted
+*/
+AvailableHole *createSlab(SlabDescriptor *desc) {
+    int slabSize = desc->objsPerSlab*(desc->itemSize+OBJ_OVERHEAD);
+    if (slabSize > maxMem) return NULL;
+    void *start = buddyAllocate(slabSize);
+    if (start == (void *)-1) return NULL;
+
+    // Set the new slab header
+    Header *header = start;
+    header->size = slabSize;
+#ifdef MM_HARDEN
+    header->tag = SLAB_TAG;
+#endif
+
+    // Set up slab pointer entry
+    AvailableHole *newSlabPtr = poolAlloc(&holePool);
+    if (newSlabPtr == NULL) {
+        buddyDeallocate(start);
+        return NULL;
+    }
+    newSlabPtr->start = (char *)(start);
+    newSlabPtr->end = (char *)(start)+desc->allocSize-1;
+    newSlabPtr->size = 0;
+    newSlabPtr->next = NULL;
+    newSlabPtr->color = desc->colorNext;
+
+    // Move the next slab one cache line further, wrapping at the unused space
+    desc->colorNext += CACHE_LINE;
+    if (desc->colorNext > desc->colorMax) desc->colorNext = 0;
+    desc->total += desc->objsPerSlab;
+
+    // Construct every object once, they keep their state until the slab is released
+    if (desc->ctor != NULL) {
+        for (int i = 0; i < desc->objsPerSlab; i++) {
+            desc->ctor(slabObject(desc, newSlabPtr, i)+HEADER_SIZE);
+        }
+    }
+    return newSlabPtr;
+}
+
+/**
+* Release Slab
+* * Destroys the objects of an unlinked slab and returns it to the buddy allocator
+* @param desc descriptor the slab belongs to
+* @param slab slab to release
+*/
+void releaseSlab(SlabDescriptor *desc, AvailableHole *slab) {
+    if (desc->dtor != NULL) {
+        for (int i = 0; i < desc->objsPerSlab; i++) {
+            desc->dtor(slabObject(desc, slab, i)+HEADER_SIZE);
+        }
+    }
+    desc->total -= desc->objsPerSlab;
+    buddyDeallocate(slab->start);
+    poolFree(&holePool, slab);
+}
 
-            // Iterate through the list to find the holes buddy
-            while (!buddyFound && nextHole != NULL && nextHole->end < newHole->start) {
-                if (nextHole->end == (char *)(newHole->start)-1) {
-                    // Do some buddy merging
-                    buddyFound = true;
-                    newHole->start = nextHole->start;
-                    newHole->size = 2*newHole->size;
-                    thisHole->next = nextHole->next;
-                    free(nextHole);
+/**
+* Slab Allocate
+* * Allocates an object from the first slab with an open spot
+* * Creates a new slab at the end of the list if every slab is full
+* @param desc descriptor to allocate from
+* @return pointer to the object, not including header, pointer to -1 if memory is exhausted
+*/
+void *slabAllocate(SlabDescriptor *desc) {
+    unsigned long fullMask = slabMask(desc->objsPerSlab);
+
+    // Find first available slot in slab, if it exists
+    int itemNumber = -1;
+    AvailableHole *lastSlab = NULL;
+    AvailableHole *currentSlab = desc->slabPtr;
+    while (currentSlab != NULL) {
+        if (currentSlab->size != fullMask) {
+            for (int i = 0; i < desc->objsPerSlab; i++) {
+                unsigned long mask = (unsigned long)1 << (63 - i);
+                if ((currentSlab->size & mask) == 0) {
+                    itemNumber = i;
                     break;
                 }
-                thisHole = nextHole;
-                nextHole = thisHole->next;
             }
+            break;
+        }
+        lastSlab = currentSlab;
+        currentSlab = currentSlab->next;
+    }
 
-            // Check finish criteria for list interation
-            if (buddyFound) {
-                thisHole = holeList[++log2size];
-            } else {
-                // If there is no nextHole and thisHole is not the buddy
-                if (nextHole == NULL) {
-                    if (thisHole->start < newHole->start) {
-                        thisHole->next = newHole;
-                        return;
-                    } else {
-                        newHole->next = thisHole;
-                        holeList[log2size] = newHole;
-                        return;
-                    }
-                }
-                // The buddy is not in the list and we are now out of order
-                if (nextHole->end > newHole->start) {
-                    thisHole->next = newHole;
-                    newHole->next = nextHole;
-                    return;
-                }
-            }
+    if (itemNumber == -1) {
+        // Allocate new slab of objs*(size+header)
+        currentSlab = createSlab(desc);
+        if (currentSlab == NULL) return (void *)-1;
+        if (lastSlab == NULL) {
+            desc->slabPtr = currentSlab;
+        } else {
+            lastSlab->next = currentSlab;
         }
+        itemNumber = 0;
     }
 
-    if (thisHole == NULL) {
-        // Add to the list
-        holeList[log2size] = newHole;
-        return;
+    // Mark new spot as taken
+    currentSlab->size |= (unsigned long)1 << (63 - itemNumber);
+    desc->used++;
+
+    // Start address for item is start address of slab + slab header + color + number of prior items * (size of items + header)
+    Header *header = (Header *)slabObject(desc, currentSlab, itemNumber);
+    header->size = desc->itemSize+REDZONE_SIZE;
+#ifdef MM_HARDEN
+    armObject(header);
+#endif
+    return (char *)(header)+HEADER_SIZE;
+}
+
+/**
+* Slab Deallocate
+* * Marks an object empty and releases its slab once the slab is empty
+* * Named caches keep their last slab so its objects stay constructed
+* @param desc descriptor the object was allocated from
+* @param ptr header of the object to free
+* @return 0 on success, -1 if ptr is not an allocated object of the descriptor
+*/
+int slabDeallocate(SlabDescriptor *desc, void *ptr) {
+    // Find slab pointer with associated object
+    AvailableHole *currentSlab = desc->slabPtr;
+    AvailableHole *prevSlab = NULL;
+    while (currentSlab != NULL) {
+        if (currentSlab->start < ptr && currentSlab->end > ptr) break;
+        prevSlab = currentSlab;
+        currentSlab = currentSlab->next;
+    }
+    if (currentSlab == NULL) return -1;
+
+    // Find slab item index in bitmap and mark empty, rejecting interior pointers and objects already free
+    long offset = (char *)ptr - slabObject(desc, currentSlab, 0);
+    int objIndex = offset / (desc->itemSize + OBJ_OVERHEAD);
+    bool object = offset >= 0 && offset % (desc->itemSize + OBJ_OVERHEAD) == 0 && objIndex < (int)desc->objsPerSlab;
+    unsigned long mask = object ? (unsigned long)1 << (63 - objIndex) : 0;
+    if ((currentSlab->size & mask) == 0) {
+#ifdef MM_HARDEN
+        heapError("free of a pointer that is not an allocated object", ptr);
+#endif
+        return -1;
     }
+    currentSlab->size &= ~mask;
+    desc->used--;
+
+    // Free the object
+    fetchHeader(ptr)->size = -1;
+
+    // Release whole slab if there are no more objects present
+    if (currentSlab->size != 0) return 0;
+    if (desc->name != NULL && prevSlab == NULL && currentSlab->next == NULL) return 0;
+    if (prevSlab != NULL) {
+        prevSlab->next = currentSlab->next;
+    } else {
+        desc->slabPtr = currentSlab->next;
+    }
+    releaseSlab(desc, currentSlab);
+
+    // Anonymous entries leave the table with their last slab
+    if (desc->name == NULL && desc->slabPtr == NULL) removeDescriptor(desc);
+    return 0;
 }
 
 /**
@@ -352,20 +753,59 @@ void buddyDeallocate(void *ptr) {
 * @param startOfMemory pointer to chunk of available memory
 */
 void setup(int mallocType, int memSize, void* startOfMemory) {
+    // A later setup drops the state of the last one, returning its nodes to the pools
+    if (holeList != NULL) {
+        for (int i = 0; i < maxAvailableHoles; i++) {
+            while (holeList[i] != NULL) {
+                AvailableHole *hole = holeList[i];
+                holeList[i] = hole->next;
+                poolFree(&holePool, hole);
+            }
+        }
+        munmap(holeList, sizeof(AvailableHole *) * maxAvailableHoles);
+        holeList = NULL;
+    }
+    for (int i = 0; i < slabItems; i++) {
+        while (descriptorTable[i]->slabPtr != NULL) {
+            AvailableHole *slab = descriptorTable[i]->slabPtr;
+            descriptorTable[i]->slabPtr = slab->next;
+            poolFree(&holePool, slab);
+        }
+        poolFree(&descriptorPool, descriptorTable[i]);
+    }
+    slabItems = 0;
+    while (reservePool.freeList != NULL) {
+        PoolNode *node = reservePool.freeList;
+        reservePool.freeList = node->next;
+        poolFree(&holePool, node);
+    }
+#ifdef MM_HARDEN
+    quarantineNext = 0;
+    quarantineCount = 0;
+#endif
+
     allocType = mallocType;
     maxMem = memSize;
     allMem = startOfMemory;
 
+    // Without its bookkeeping the allocator fails every allocation
     maxAvailableHoles = convertSize(memSize) + 1;
-    holeList = malloc(sizeof(AvailableHole *) * maxAvailableHoles);
+    holeList = mapArray(sizeof(AvailableHole *) * maxAvailableHoles);
+    AvailableHole *maxHole = holeList != NULL ? poolAlloc(&holePool) : NULL;
+    if (maxHole == NULL) {
+        if (holeList != NULL) munmap(holeList, sizeof(AvailableHole *) * maxAvailableHoles);
+        holeList = NULL;
+        maxMem = 0;
+        maxAvailableHoles = 0;
+        return;
+    }
 
     for (int i = 0; i < maxAvailableHoles; i++) {
         holeList[i] = NULL;
     }
 
-    AvailableHole *maxHole = malloc(sizeof(AvailableHole));;
     maxHole->start = (char *)(startOfMemory);
-    maxHole->end = (char *)(startOfMemory+memSize);
+    maxHole->end = (char *)(startOfMemory)+memSize-1;
     maxHole->next = NULL;
     maxHole->size = memSize;
     holeList[maxAvailableHoles-1] = maxHole;
@@ -384,110 +824,32 @@ void *my_malloc(int size) {
         // Check that memory can be allocated
         if (size > maxMem) return retVal;
         // Get and check next memory address
-        void *start = buddyAllocate(size);
+        void *start = buddyAllocate(size+REDZONE_SIZE);
         if (start == (void *)-1) return retVal;
 
         // Allocate header
         Header *header = start;
-        header->size = size;
-        retVal = (char *)(header)+4;
+        header->size = size+REDZONE_SIZE;
+#ifdef MM_HARDEN
+        armObject(header);
+#endif
+        retVal = (char *)(header)+HEADER_SIZE;
     } else if (allocType == SLAB) {
         // Check if slab entry exists
         int index = findDescriptorIndex(size);
-
+        SlabDescriptor *desc;
         if (index > -1) {
-            // Find first available slot in slab, if it exists
-            int itemNumber = -1;
-            AvailableHole *currentSlab = descriptorTable[index]->slabPtr;
-            while (currentSlab != NULL && itemNumber == -1) {
-                if (currentSlab->size != ULONG_MAX) {
-                    for (int i = 0; i < N_OBJS_PER_SLAB; i++) {
-                        long mask = (long)1 << (63 - i);
-                        if ((currentSlab->size & mask) == 0) {
-                            // Mark new spot as taken
-                            currentSlab->size |= mask;
-                            itemNumber = i;
-                            break;
-                        }
-                    }
-                }
-                if (itemNumber == -1 && currentSlab->next == NULL) break;
-                if (itemNumber == -1) currentSlab = currentSlab->next;
-            }
-
-            if (itemNumber > -1) {
-                descriptorTable[index]->used++;
-
-                // Start address for item is start address of slab + slab header + number of prior items * (size of items + header)
-                void *start = (char *)(currentSlab->start)+4 + itemNumber*(size+4);
-                Header *header = start;
-                header->size = size;
-                retVal = (char *)(header)+4;
-            } else {
-                // Allocate new slab of 64*(size+header)
-                void *start = buddyAllocate(N_OBJS_PER_SLAB*(size+4));
-                if (start == (void *)-1) return retVal;
-
-                // Set the new slab header
-                Header *header = start;
-                header->size = (N_OBJS_PER_SLAB * (size+4));
-
-                // Set up slab entry
-                AvailableHole *newSlabPtr = malloc(sizeof(AvailableHole));
-                newSlabPtr->start = (char *)(start);
-                newSlabPtr->end = (char *)(start)+N_OBJS_PER_SLAB*(4+size)-1;
-                newSlabPtr->size = ((long)1 << 63);
-                newSlabPtr->next = NULL;
-
-                // Update descriptor table
-                descriptorTable[index]->total += N_OBJS_PER_SLAB;
-                descriptorTable[index]->used += 1;
-                currentSlab->next = newSlabPtr;
-
-                // Allocate item in new slab
-                start = (char *)(start)+4;
-                header = start;
-                header->size = size;
-
-                // Set up return value
-                retVal = (char *)(header)+4;
-            }
+            desc = descriptorTable[index];
         } else {
             // Check slab can be allocated
-            if (N_OBJS_PER_SLAB*(size+4) > maxMem) return retVal;
-            // Allocate new slab
-            void *start = buddyAllocate(N_OBJS_PER_SLAB*(size+4));
-            if (start == (void *)-1) return retVal;
-
-            // Set up slab pointer entry
-            AvailableHole *newSlabPtr = malloc(sizeof(AvailableHole));
-            newSlabPtr->start = (char *)(start);
-            newSlabPtr->end = (char *)(start)+N_OBJS_PER_SLAB*(size+4)-1;
-            newSlabPtr->size = ((long)1 << 63);
-            newSlabPtr->next = NULL;
-
-            // Set up slab entry data
-            descriptorTable = realloc(descriptorTable, (++slabItems)*sizeof(SlabDescriptor));
-            SlabDescriptor *newSlabDescriptor = malloc(sizeof(SlabDescriptor));
-            newSlabDescriptor->itemSize = size;
-            newSlabDescriptor->allocSize = convertIndex(convertSize(N_OBJS_PER_SLAB*(size+4)));
-            newSlabDescriptor->total = N_OBJS_PER_SLAB;
-            newSlabDescriptor->used = 1;
-            newSlabDescriptor->slabPtr = newSlabPtr;
-            descriptorTable[slabItems-1] = newSlabDescriptor;
-
-            // Set the new slab header
-            Header *header = start;
-            header->size = (N_OBJS_PER_SLAB*(size+4));
-
-            // Allocate item in new slab
-            start = (char *)(start)+4;
-            header = start;
-            header->size = size;
-
-            // Set up return value
-            retVal = (char *)(header)+4;
+            if (slabObjects*(size+OBJ_OVERHEAD) > maxMem) return retVal;
+            desc = createDescriptor(NULL, size, slabObjects, NULL, NULL, false);
+            if (desc == NULL) return retVal;
         }
+
+        retVal = slabAllocate(desc);
+        // Drop a new entry whose first slab could not be allocated
+        if (desc->slabPtr == NULL) removeDescriptor(desc);
     }
 
     return retVal;
@@ -501,51 +863,217 @@ void *my_malloc(int size) {
 * @return None
 */
 void my_free(void *ptr) {
-    ptr = (char *)(ptr)-4;
+    ptr = (char *)(ptr)-HEADER_SIZE;
+
+#ifdef MM_HARDEN
+    // Validate and tag the object, sampled frees are held in quarantine first
+    checkObject(ptr, allocType == BUDDY);
+    fetchHeader(ptr)->tag = FREE_TAG;
+    if (++freeCount % QUARANTINE_RATE == 0) {
+        ptr = quarantineObject(fetchHeader(ptr));
+        if (ptr == NULL) return;
+    }
+#endif
 
     if (allocType == BUDDY) {
         buddyDeallocate(ptr);
     } else if (allocType == SLAB) {
         // Find slab descriptor entry
         Header *header = fetchHeader(ptr);
-        int tableIndex = findDescriptorIndex(header->size);
+        int tableIndex = findDescriptorIndex(header->size-REDZONE_SIZE);
         if (tableIndex == -1) return;
+        slabDeallocate(descriptorTable[tableIndex], ptr);
+    }
+}
+
+/**
+* Set Slab Objects
+* * Sets the objects per slab used by my_malloc for new object sizes
+* @param objs objects per slab, clamped to 1 through 64
+*/
+void set_slab_objects(int objs) {
+    if (objs < 1) objs = 1;
+    if (objs > 64) objs = 64;
+    slabObjects = objs;
+}
 
-        // Find slab pointer with associated object
-        AvailableHole *currentSlab = descriptorTable[tableIndex]->slabPtr;
-        AvailableHole *prevSlab = NULL;
-        while (currentSlab != NULL) {
-            if (currentSlab->start < ptr && currentSlab->end > ptr) break;
-            if (currentSlab->next == NULL) break;
-            prevSlab = currentSlab;
-            currentSlab = currentSlab->next;
+/**
+* My Cache Create
+* * Creates a named object cache backed by colored slabs
+* @param name name of the cache, must outlive the cache
+* @param size size of each object
+* @param objs_per_slab objects per slab, 0 for the my_malloc default, at most 64
+* @param ctor constructor run on every object when its slab is created, may be NULL
+* @param dtor destructor run on every object when its slab is released, may be NULL
+* @return cache handle, NULL if a slab cannot fit in memory or its bookkeeping can't be mapped
+*/
+MyCache *my_cache_create(const char *name, int size, int objs_per_slab, void (*ctor)(void *), void (*dtor)(void *)) {
+    int objs = objs_per_slab > 0 ? objs_per_slab : slabObjects;
+    if (objs > 64) objs = 64;
+    if (size <= 0 || objs*(size+OBJ_OVERHEAD) > maxMem) return NULL;
+    return createDescriptor(name != NULL ? name : "", size, objs, ctor, dtor, true);
+}
+
+/**
+* My Cache Alloc
+* * Allocates a constructed object from the cache
+* @param cache cache to allocate from
+* @return pointer to the object, pointer to -1 if it can't be allocated
+*/
+void *my_cache_alloc(MyCache *cache) {
+    if (cache == NULL) return (void *)-1;
+    return slabAllocate(cache);
+}
+
+/**
+* My Cache Free
+* * Returns an object to its cache without destroying it
+* @param cache cache the object was allocated from
+* @param ptr object to free
+* @return 0 on success, -1 if ptr is not an allocated object of the cache
+*/
+int my_cache_free(MyCache *cache, void *ptr) {
+    if (cache == NULL || ptr == NULL) return -1;
+    ptr = (char *)(ptr)-HEADER_SIZE;
+#ifdef MM_HARDEN
+    checkObject(ptr, false);
+    fetchHeader(ptr)->tag = FREE_TAG;
+#endif
+    return slabDeallocate(cache, ptr);
+}
+
+/**
+* My Cache Destroy
+* * Releases every slab of the cache and the cache itself
+* @param cache cache to destroy
+*/
+void my_cache_destroy(MyCache *cache) {
+    if (cache == NULL) return;
+    AvailableHole *currentSlab = cache->slabPtr;
+    while (currentSlab != NULL) {
+        AvailableHole *nextSlab = currentSlab->next;
+        releaseSlab(cache, currentSlab);
+        currentSlab = nextSlab;
+    }
+    removeDescriptor(cache);
+}
+
+/**
+* Check Error
+* * Reports one inconsistency found by my_heap_check
+* @param errors error counter to increase
+* @param what description of the inconsistency
+* @param ptr address where it was found
+*/
+void checkError(int *errors, const char *what, void *ptr) {
+    fprintf(stderr, "my_heap_check: %s at offset %ld\n", what, (long)((char *)ptr - (char *)allMem));
+    (*errors)++;
+}
+
+/**
+* Compare Holes
+* * Orders holes by start address for qsort
+*/
+int compareHoles(const void *a, const void *b) {
+    char *startA = (*(AvailableHole **)a)->start;
+    char *startB = (*(AvailableHole **)b)->start;
+    return (startA > startB) - (startA < startB);
+}
+
+/**
+* My Heap Check
+* * Walks holeList, the whole memory chunk and every slab checking their consistency
+* * Each problem found is printed to stderr
+* @return number of problems found, 0 for a consistent heap
+*/
+int my_heap_check(void) {
+    int errors = 0;
+    char *memEnd = (char *)(allMem)+maxMem;
+
+    // Check every hole list is in ascending address order with holes of its size
+    int nHoles = 0;
+    for (int i = 0; i < maxAvailableHoles; i++) {
+        AvailableHole *prevHole = NULL;
+        for (AvailableHole *hole = holeList[i]; hole != NULL; hole = hole->next) {
+            if (hole->size != convertIndex(i) && i != maxAvailableHoles-1) checkError(&errors, "hole size does not match its list", hole->start);
+            if ((char *)(hole->start) < (char *)allMem || (char *)(hole->end) >= memEnd) checkError(&errors, "hole outside memory", hole->start);
+            if ((char *)(hole->end) != (char *)(hole->start)+hole->size-1) checkError(&errors, "hole end does not match its size", hole->start);
+            if (((char *)(hole->start) - (char *)allMem) % hole->size != 0) checkError(&errors, "hole not aligned to its size", hole->start);
+            if (prevHole != NULL && prevHole->start >= hole->start) checkError(&errors, "hole list out of order", hole->start);
+            prevHole = hole;
+            nHoles++;
         }
-        if (currentSlab == NULL) return;
+    }
+
+    AvailableHole **holes = mapArray(sizeof(AvailableHole *) * (nHoles+1));
+    if (holes == NULL) {
+        fprintf(stderr, "my_heap_check: cannot map the hole array\n");
+        return errors+1;
+    }
+    nHoles = 0;
+    for (int i = 0; i < maxAvailableHoles; i++) {
+        for (AvailableHole *hole = holeList[i]; hole != NULL; hole = hole->next) holes[nHoles++] = hole;
+    }
+    qsort(holes, nHoles, sizeof(AvailableHole *), compareHoles);
 
-        // Find slab item index in bitmap and mark empty
-        int objIndex = ((char *)ptr - (char *)(currentSlab->start)+4) / (header->size + 4);
-        currentSlab->size -= ((long)1 << (63 - objIndex));
+    // Walk the whole chunk, holes and allocated chunks must cover it exactly once
+    char *addr = (char *)allMem;
+    int k = 0;
+    while (addr < memEnd) {
+        if (k < nHoles && (char *)(holes[k]->start) < addr) {
+            checkError(&errors, "overlapping holes", holes[k]->start);
+            k++;
+            continue;
+        }
+        if (k < nHoles && (char *)(holes[k]->start) == addr) {
+            addr += holes[k++]->size;
+            continue;
+        }
 
-        // Free the object
-        header->size = -1;
+        Header *header = fetchHeader(addr);
+        if (header->size+HEADER_SIZE > maxMem) {
+            checkError(&errors, "allocated chunk with corrupted size", addr);
+            break;
+        }
+        int chunkSize = convertIndex(convertSize(header->size+HEADER_SIZE));
+        if ((addr - (char *)allMem) % chunkSize != 0) {
+            checkError(&errors, "allocated chunk not aligned to its size", addr);
+            break;
+        }
+        if (k < nHoles && (char *)(holes[k]->start) < addr+chunkSize) checkError(&errors, "allocated chunk overlaps a hole", addr);
+#ifdef MM_HARDEN
+        if (header->tag == ALLOC_TAG && !redzoneIntact(header)) checkError(&errors, "heap overflow past end of object", addr);
+        if (header->tag == FREE_TAG && !inQuarantine(header)) checkError(&errors, "freed chunk never returned to the hole list", addr);
+        if (header->tag != ALLOC_TAG && header->tag != FREE_TAG && header->tag != SLAB_TAG) checkError(&errors, "corrupted chunk header", addr);
+#endif
+        addr += chunkSize;
+    }
+    munmap(holes, sizeof(AvailableHole *) * (nHoles+1));
 
-        // Release whole slab if there are no more objects present
-        if (currentSlab->size == 0) {
-            buddyDeallocate(currentSlab->start);
-            if (prevSlab != NULL) {
-                prevSlab->next = currentSlab->next;
-            } else {
-                if (currentSlab->next == NULL) {
-                    // Swap end of table to current position and realloc the table
-                    SlabDescriptor *tempDescriptor = descriptorTable[--slabItems];
-                    free(descriptorTable[tableIndex]);
-                    descriptorTable[tableIndex] = tempDescriptor;
-                    descriptorTable = realloc(descriptorTable, slabItems*sizeof(SlabDescriptor));
-                } else {
-                    descriptorTable[tableIndex]->slabPtr = currentSlab->next;
-                }
+    // Check every slab bitmap against its objects and the descriptor counts
+    for (int i = 0; i < slabItems; i++) {
+        SlabDescriptor *desc = descriptorTable[i];
+        unsigned int used = 0;
+        for (AvailableHole *slab = desc->slabPtr; slab != NULL; slab = slab->next) {
+            if ((char *)(slab->start) < (char *)allMem || (char *)(slab->end) >= memEnd) {
+                checkError(&errors, "slab outside memory", slab->start);
+                continue;
+            }
+            if ((slab->size & ~slabMask(desc->objsPerSlab)) != 0) checkError(&errors, "slab bitmap marks objects past the end of the slab", slab->start);
+            if (slab->color > desc->colorMax) checkError(&errors, "slab color past the unused space", slab->start);
+            for (int j = 0; j < desc->objsPerSlab; j++) {
+                if ((slab->size & ((unsigned long)1 << (63 - j))) == 0) continue;
+                used++;
+#ifdef MM_HARDEN
+                Header *header = (Header *)slabObject(desc, slab, j);
+                if (header->tag == FREE_TAG && inQuarantine(header)) continue;
+                if (header->tag != ALLOC_TAG) checkError(&errors, "allocated slab object with bad tag", header);
+                else if (!redzoneIntact(header)) checkError(&errors, "heap overflow past end of object", header);
+#endif
             }
-            free(currentSlab);
         }
+        if (used != desc->used) checkError(&errors, "slab descriptor used count does not match bitmaps", desc->slabPtr != NULL ? desc->slabPtr->start : allMem);
     }
+
+    return errors;
 }
@@ -0,0 +1,50 @@
+// my_memory.h
+// Description: Interface of the buddy and slab memory allocator
+
+#ifndef _MY_MEMORY_H
+#define _MY_MEMORY_H
+
+// Object cache handle returned by my_cache_create
+typedef struct SlabDescriptor MyCache;
+
+/* 'setup()' hands 'mem_size' bytes at 'start_of_memory' to the allocator.
+ * 'malloc_type' can take values 0 or 1 -- 0 indicates buddy allocation and 1 indicates slab allocation.
+ * A later call drops every allocation and cache of the previous one. If the allocator's bookkeeping
+ * cannot be mapped, every allocation fails.
+ */
+extern void setup(int malloc_type, int mem_size, void* start_of_memory);
+
+/* 'my_malloc()' returns a pointer to 'size' bytes, or (void *)-1 if it cannot be allocated.
+ * 'my_free()' releases a pointer returned by 'my_malloc()'.
+ */
+extern void *my_malloc(int size);
+extern void my_free(void *ptr);
+
+/* 'set_slab_objects()' sets the number of objects per slab, 1 to 64, used by 'my_malloc()'
+ * for object sizes it has not seen yet. Defaults to 64.
+ */
+extern void set_slab_objects(int objs);
+
+/* Named object caches in the style of kmem_cache.
+ * 'my_cache_create()' creates a cache of 'size' byte objects with 'objs_per_slab' objects
+ * in every slab (0 for the default). 'ctor' runs once on every object when its slab is
+ * created and 'dtor' once when the slab is released, so objects keep their constructed
+ * state between 'my_cache_free()' and 'my_cache_alloc()'. Either may be NULL.
+ * Consecutive slabs of a cache start their objects at different cache line offsets.
+ * 'my_cache_create()' returns NULL if a slab of the cache cannot fit in memory.
+ * 'my_cache_free()' returns -1 for a pointer that is not an allocated object of the cache,
+ * such as one into an object or one already freed, and leaves the cache unchanged.
+ */
+extern MyCache *my_cache_create(const char *name, int size, int objs_per_slab, void (*ctor)(void *), void (*dtor)(void *));
+extern void *my_cache_alloc(MyCache *cache);
+extern int my_cache_free(MyCache *cache, void *ptr);
+extern void my_cache_destroy(MyCache *cache);
+
+/* 'my_heap_check()' walks the hole lists, the whole memory chunk and every slab, printing
+ * each inconsistency to stderr. Returns the number found, 0 for a consistent heap.
+ * Built with -DMM_HARDEN, objects also carry free-state tags and redzones that are
+ * checked here and on every free, where corruption aborts the program.
+ */
+extern int my_heap_check(void);
+
+#endif
@@ -0,0 +1,404 @@
+// replay.c
+// Description: Replays a binary allocation trace against the buddy, slab and
+//              glibc allocators and reports per-op latency histograms
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "trace.h"
+
+#define  N_BUCKETS        40
+#define  N_ALLOCATORS     3
+#define  BUDDY            0
+#define  SLAB             1
+#define  GLIBC            2
+
+extern void setup(int malloc_type, int mem_size, void* start_of_memory);
+extern void *my_malloc(int size);
+extern void my_free(void *ptr);
+
+/**
+* Data Structures
+*/
+
+// Histogram
+//  count - Number of ops whose latency fell in [2^(i-1), 2^i) ns, bucket 0 is < 1ns
+//  ops - Number of timed ops
+//  failures - Number of allocations the allocator could not satisfy
+//  totalNs - Sum of all op latencies
+//  maxNs - Largest single op latency
+typedef struct {
+    unsigned long count[N_BUCKETS];
+    unsigned long ops;
+    unsigned long failures;
+    double totalNs;
+    double maxNs;
+} Histogram;
+
+// Replay result for a single allocator, written by the replay child
+//  alloc - Allocation latency histogram
+//  free - Free latency histogram
+//  wallNs - Wall time of the full replay including bookkeeping
+//  done - Set once the child finished the replay
+typedef struct {
+    Histogram alloc;
+    Histogram free;
+    double wallNs;
+    int done;
+} ReplayResult;
+
+/**
+* Global Variables
+*/
+
+const char *allocatorNames[N_ALLOCATORS] = {"buddy", "slab", "glibc"};
+
+const TraceHeader *traceHeader;
+const TraceOp *traceOps;
+double ticksPerNs = 1.0;
+int memSize = 1 << 20;
+
+/**
+* Helper Functions
+*/
+
+/**
+* Read Timer
+* * Reads the cycle counter where available, otherwise the monotonic clock in ns
+* @return current timer value in ticks
+*/
+static inline uint64_t readTimer(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/**
+* Monotonic Nanoseconds
+* * Reads CLOCK_MONOTONIC in nanoseconds
+* @return current monotonic time in ns
+*/
+static double monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+* Calibrate Timer
+* * Measures readTimer ticks against CLOCK_MONOTONIC for roughly 20ms
+* @return ticks per nanosecond
+*/
+double calibrateTimer(void) {
+    double startNs = monotonicNs();
+    uint64_t startTicks = readTimer();
+    while (monotonicNs() - startNs < 20e6);
+    double elapsedNs = monotonicNs() - startNs;
+    uint64_t elapsedTicks = readTimer() - startTicks;
+    return elapsedTicks / elapsedNs;
+}
+
+/**
+* Record Latency
+* * Adds one op latency to the histogram
+* @param hist histogram to update
+* @param ticks latency of the op in timer ticks
+*/
+static inline void recordLatency(Histogram *hist, uint64_t ticks) {
+    double ns = ticks / ticksPerNs;
+    unsigned long whole = (unsigned long)ns;
+    int bucket = 0;
+    while (whole > 0 && bucket < N_BUCKETS - 1) {
+        whole >>= 1;
+        bucket++;
+    }
+    hist->count[bucket]++;
+    hist->ops++;
+    hist->totalNs += ns;
+    if (ns > hist->maxNs) hist->maxNs = ns;
+}
+
+/**
+* Percentile
+* * Finds the bucket upper bound holding the given quantile
+* @param hist histogram to read
+* @param quantile fraction of ops in [0, 1]
+* @return upper bound in ns of the bucket containing the quantile
+*/
+unsigned long percentile(const Histogram *hist, double quantile) {
+    unsigned long target = (unsigned long)(quantile * hist->ops);
+    unsigned long seen = 0;
+    for (int i = 0; i < N_BUCKETS; i++) {
+        seen += hist->count[i];
+        if (seen > target) return 1ul << i;
+    }
+    return 1ul << (N_BUCKETS - 1);
+}
+
+/**
+* Load Trace
+* * Maps the binary trace file and validates its header and handles
+* @param path path to the trace file
+* @return 0 on success, -1 on an unreadable or malformed trace
+*/
+int loadTrace(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Invalid trace file specified: %s\n", path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(TraceHeader)) {
+        printf("Trace file too short: %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    traceHeader = map;
+    traceOps = (const TraceOp *)(traceHeader+1);
+    if (memcmp(traceHeader->magic, TRACE_MAGIC, 4) != 0 || traceHeader->version != TRACE_VERSION) {
+        printf("Not a version %d allocation trace: %s\n", TRACE_VERSION, path);
+        return -1;
+    }
+    if (sizeof(TraceHeader) + traceHeader->nOps*sizeof(TraceOp) > (uint64_t)st.st_size) {
+        printf("Trace file truncated: %s\n", path);
+        return -1;
+    }
+
+    // A handle must be freed before it is allocated again, or the replay would lose its object
+    unsigned char *live = calloc(traceHeader->nHandles, 1);
+    if (live == NULL) exit(-1);
+    for (uint64_t i = 0; i < traceHeader->nOps; i++) {
+        const TraceOp *op = &traceOps[i];
+        if (op->handle >= traceHeader->nHandles) continue;
+        if (op->type == OP_ALLOC) {
+            if (live[op->handle]) {
+                printf("Trace allocates live handle %u at op %lu: %s\n", op->handle, (unsigned long)i, path);
+                free(live);
+                return -1;
+            }
+            live[op->handle] = 1;
+        } else if (op->type == OP_FREE) {
+            live[op->handle] = 0;
+        }
+    }
+    free(live);
+    return 0;
+}
+
+/**
+* Replay
+* * Replays the whole trace against one allocator
+* * Handles are kept in an array indexed by the trace handle
+* @param allocator BUDDY, SLAB or GLIBC
+* @param result result block to fill
+*/
+void replay(int allocator, ReplayResult *result) {
+    void **slots = calloc(traceHeader->nHandles, sizeof(void *));
+    if (slots == NULL) exit(-1);
+
+    if (allocator != GLIBC) {
+        void *ram = mmap(NULL, memSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (ram == MAP_FAILED) exit(-1);
+        setup(allocator, memSize, ram);
+    }
+
+    double startNs = monotonicNs();
+    for (uint64_t i = 0; i < traceHeader->nOps; i++) {
+        const TraceOp *op = &traceOps[i];
+        if (op->handle >= traceHeader->nHandles) continue;
+
+        if (op->type == OP_ALLOC) {
+            void *ptr;
+            uint64_t t0 = readTimer();
+            if (allocator == GLIBC) {
+                ptr = malloc(op->size);
+            } else {
+                ptr = my_malloc(op->size);
+            }
+            uint64_t t1 = readTimer();
+            recordLatency(&result->alloc, t1 - t0);
+
+            if (ptr == NULL || ptr == (void *)-1) {
+                result->alloc.failures++;
+                ptr = NULL;
+            }
+            slots[op->handle] = ptr;
+        } else if (op->type == OP_FREE) {
+            void *ptr = slots[op->handle];
+            if (ptr == NULL) continue;
+            uint64_t t0 = readTimer();
+            if (allocator == GLIBC) {
+                free(ptr);
+            } else {
+                my_free(ptr);
+            }
+            uint64_t t1 = readTimer();
+            recordLatency(&result->free, t1 - t0);
+            slots[op->handle] = NULL;
+        }
+    }
+    result->wallNs = monotonicNs() - startNs;
+    result->done = 1;
+}
+
+/**
+* Print Histograms
+* * Prints the histograms of every allocator side by side
+* @param title table title
+* @param results replay results of every allocator
+* @param alloc non-zero to print allocation latency, zero for free latency
+*/
+void printHistograms(const char *title, ReplayResult *results, int alloc) {
+    int low = N_BUCKETS, high = -1;
+    for (int a = 0; a < N_ALLOCATORS; a++) {
+        Histogram *hist = alloc ? &results[a].alloc : &results[a].free;
+        for (int i = 0; i < N_BUCKETS; i++) {
+            if (hist->count[i] == 0) continue;
+            if (i < low) low = i;
+            if (i > high) high = i;
+        }
+    }
+
+    printf("%s latency (ns)\n", title);
+    printf("%-22s", "bucket");
+    for (int a = 0; a < N_ALLOCATORS; a++) printf("%14s", allocatorNames[a]);
+    printf("\n");
+    for (int i = low; i <= high; i++) {
+        char range[32];
+        snprintf(range, sizeof(range), "[%lu, %lu)", i == 0 ? 0ul : 1ul << (i-1), 1ul << i);
+        printf("%-22s", range);
+        for (int a = 0; a < N_ALLOCATORS; a++) {
+            Histogram *hist = alloc ? &results[a].alloc : &results[a].free;
+            printf("%14lu", hist->count[i]);
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+/**
+* Print Summary
+* * Prints counts, mean, percentiles and throughput of every allocator
+* @param results replay results of every allocator
+*/
+void printSummary(ReplayResult *results) {
+    printf("%-22s", "summary");
+    for (int a = 0; a < N_ALLOCATORS; a++) printf("%14s", allocatorNames[a]);
+    printf("\n");
+
+    printf("%-22s", "allocs");
+    for (int a = 0; a < N_ALLOCATORS; a++) printf("%14lu", results[a].alloc.ops);
+    printf("\n%-22s", "alloc failures");
+    for (int a = 0; a < N_ALLOCATORS; a++) printf("%14lu", results[a].alloc.failures);
+    printf("\n%-22s", "frees");
+    for (int a = 0; a < N_ALLOCATORS; a++) printf("%14lu", results[a].free.ops);
+    printf("\n%-22s", "alloc mean ns");
+    for (int a = 0; a < N_ALLOCATORS; a++) {
+        Histogram *hist = &results[a].alloc;
+        printf("%14.1f", hist->ops ? hist->totalNs / hist->ops : 0.0);
+    }
+    printf("\n%-22s", "alloc p50/p99 ns");
+    for (int a = 0; a < N_ALLOCATORS; a++) {
+        char cell[48];
+        snprintf(cell, sizeof(cell), "%lu/%lu", percentile(&results[a].alloc, 0.5), percentile(&results[a].alloc, 0.99));
+        printf("%14s", cell);
+    }
+    printf("\n%-22s", "alloc max ns");
+    for (int a = 0; a < N_ALLOCATORS; a++) printf("%14.0f", results[a].alloc.maxNs);
+    printf("\n%-22s", "free mean ns");
+    for (int a = 0; a < N_ALLOCATORS; a++) {
+        Histogram *hist = &results[a].free;
+        printf("%14.1f", hist->ops ? hist->totalNs / hist->ops : 0.0);
+    }
+    printf("\n%-22s", "free p50/p99 ns");
+    for (int a = 0; a < N_ALLOCATORS; a++) {
+        char cell[48];
+        snprintf(cell, sizeof(cell), "%lu/%lu", percentile(&results[a].free, 0.5), percentile(&results[a].free, 0.99));
+        printf("%14s", cell);
+    }
+    printf("\n%-22s", "free max ns");
+    for (int a = 0; a < N_ALLOCATORS; a++) printf("%14.0f", results[a].free.maxNs);
+    printf("\n%-22s", "throughput Mops/s");
+    for (int a = 0; a < N_ALLOCATORS; a++) {
+        double ops = results[a].alloc.ops + results[a].free.ops;
+        printf("%14.2f", results[a].wallNs > 0 ? ops * 1e3 / results[a].wallNs : 0.0);
+    }
+    printf("\n");
+}
+
+/**
+* Main Functions
+*/
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "m:")) != -1) {
+        if (opt == 'm') {
+            memSize = atoi(optarg);
+        } else {
+            argc = 0;
+        }
+    }
+
+    if (argc == 0 || optind >= argc) {
+        printf("Usage: ./replay [-m <mem_size>] <trace_file>\n");
+        printf("  mem_size: bytes managed by the buddy and slab allocators, default 1048576\n");
+        return -1;
+    }
+    if (loadTrace(argv[optind]) < 0) return -1;
+
+    ticksPerNs = calibrateTimer();
+#if defined(__x86_64__) || defined(__i386__)
+    const char *timerName = "rdtsc";
+#else
+    const char *timerName = "clock_gettime";
+#endif
+    printf("Trace: %s\nOps: %lu  Handles: %u  Mem size: %d  Timer: %s (%.3f ticks/ns)\n\n", argv[optind],
+        (unsigned long)traceHeader->nOps, traceHeader->nHandles, memSize, timerName, ticksPerNs);
+
+    // Each allocator replays in its own child so allocator state never leaks between runs
+    ReplayResult *results = mmap(NULL, sizeof(ReplayResult) * N_ALLOCATORS, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) return -1;
+    memset(results, 0, sizeof(ReplayResult) * N_ALLOCATORS);
+
+    fflush(stdout);
+    for (int a = 0; a < N_ALLOCATORS; a++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            replay(a, &results[a]);
+            _exit(0);
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !results[a].done) {
+            printf("Replay with %s allocator did not complete\n", allocatorNames[a]);
+        }
+    }
+
+    printHistograms("Allocation", results, 1);
+    printHistograms("Free", results, 0);
+    printSummary(results);
+    return 0;
+}
@@ -0,0 +1,54 @@
+// trace.h
+// Description: Compact binary allocation trace format shared by the
+//              replay benchmark, the trace converter and the P3 allocator benchmark
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+#define  TRACE_MAGIC      "MTRC"
+#define  TRACE_VERSION    1
+
+/**
+* Data Structures
+*/
+
+// Trace operation type
+//  OP_ALLOC - Allocate size bytes into handle slot
+//  OP_FREE - Free the object held in handle slot
+//  OP_READ - Read the byte at offset size of the object held in handle slot
+//  OP_WRITE - Write the byte at offset size of the object held in handle slot
+// Replay skips OP_READ and OP_WRITE, which only the P3 allocator benchmark uses
+typedef enum {
+    OP_ALLOC = 0,
+    OP_FREE  = 1,
+    OP_READ  = 2,
+    OP_WRITE = 3
+} TraceOpType;
+
+// Trace file header
+//  magic - Always TRACE_MAGIC
+//  version - Format version, TRACE_VERSION
+//  nOps - Number of TraceOp records following the header
+//  nHandles - Number of handle slots, every op handle is below this
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t nOps;
+    uint32_t nHandles;
+    uint32_t reserved;
+} TraceHeader;
+
+// Trace operation record
+//  handle - Dense slot index used to look up the live object
+//  size - Requested size for OP_ALLOC, 0 for OP_FREE, offset for OP_READ and OP_WRITE
+//  type - TraceOpType of the record
+typedef struct {
+    uint32_t handle;
+    uint32_t size;
+    uint8_t type;
+    uint8_t pad[3];
+} TraceOp;
+
+#endif
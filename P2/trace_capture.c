@@ -0,0 +1,192 @@
+// trace_capture.c
+// Description: LD_PRELOAD library that records every malloc family call of a
+//              process as a text trace for trace_convert
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#define  BUFFER_SIZE      (1 << 16)
+#define  LINE_SIZE        96
+#define  EXPORT           __attribute__((visibility("default")))
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+/**
+* Global Variables
+*/
+
+pthread_mutex_t captureLock = PTHREAD_MUTEX_INITIALIZER;
+int captureFd = -1;
+char captureBuffer[BUFFER_SIZE];
+int captureLength = 0;
+
+// Set while a thread is inside the recorder so nested calls are not traced
+static __thread int inCapture __attribute__((tls_model("initial-exec")));
+
+/**
+* Helper Functions
+*/
+
+/**
+* Flush Buffer
+* * Writes the buffered trace lines to the trace file
+* * Caller must hold captureLock
+*/
+static void flushBuffer(void) {
+    int written = 0;
+    while (captureFd >= 0 && written < captureLength) {
+        ssize_t n = write(captureFd, captureBuffer + written, captureLength - written);
+        if (n <= 0 && errno != EINTR) break;
+        if (n > 0) written += n;
+    }
+    captureLength = 0;
+}
+
+/**
+* Open Trace
+* * Opens <P2_TRACE_FILE>.<pid>, or malloc_trace.<pid> when the variable is unset
+*/
+static void openTrace(void) {
+    const char *base = getenv("P2_TRACE_FILE");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.%d", base != NULL ? base : "malloc_trace", (int)getpid());
+    captureFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+
+/**
+* Append Line
+* * Appends one trace line to the buffer, flushing it first if it is full
+* * Caller must hold captureLock
+* @param line the line
+* @param length length of the line
+*/
+static void appendLine(const char *line, int length) {
+    if (captureLength + length > BUFFER_SIZE) flushBuffer();
+    memcpy(captureBuffer + captureLength, line, length);
+    captureLength += length;
+}
+
+/**
+* Record
+* * Appends one formatted trace line to the buffer
+* @param fmt printf style format of the line
+*/
+static void record(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void record(const char *fmt, ...) {
+    if (captureFd < 0) return;
+    inCapture = 1;
+
+    char line[LINE_SIZE];
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    pthread_mutex_lock(&captureLock);
+    appendLine(line, length);
+    pthread_mutex_unlock(&captureLock);
+
+    inCapture = 0;
+}
+
+/**
+* Fork Handlers
+* * Keep the buffer consistent across fork and give the child its own trace file
+*/
+static void forkPrepare(void) {
+    pthread_mutex_lock(&captureLock);
+}
+
+static void forkParent(void) {
+    pthread_mutex_unlock(&captureLock);
+}
+
+static void forkChild(void) {
+    captureLength = 0;
+    openTrace();
+    pthread_mutex_unlock(&captureLock);
+}
+
+__attribute__((constructor)) static void captureInit(void) {
+    inCapture = 1;
+    openTrace();
+    pthread_atfork(forkPrepare, forkParent, forkChild);
+    inCapture = 0;
+}
+
+__attribute__((destructor)) static void captureFini(void) {
+    pthread_mutex_lock(&captureLock);
+    flushBuffer();
+    pthread_mutex_unlock(&captureLock);
+}
+
+/**
+* Main Functions
+* * Trace lines, all numbers in hex except sizes
+* *   m <size> <ptr>          malloc, calloc and memalign family
+* *   r <oldPtr> <size> <ptr> realloc
+* *   f <ptr>                 free
+*/
+
+EXPORT void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    if (!inCapture) record("m %zu %lx\n", size, (unsigned long)ptr);
+    return ptr;
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size) {
+    void *ptr = __libc_calloc(nmemb, size);
+    if (!inCapture) record("m %zu %lx\n", nmemb * size, (unsigned long)ptr);
+    return ptr;
+}
+
+EXPORT void *realloc(void *oldPtr, size_t size) {
+    if (inCapture || captureFd < 0) return __libc_realloc(oldPtr, size);
+    // Recorded under the lock held across the call, so no thread can log a reuse of oldPtr first
+    inCapture = 1;
+    pthread_mutex_lock(&captureLock);
+    void *ptr = __libc_realloc(oldPtr, size);
+    char line[LINE_SIZE];
+    int length = snprintf(line, sizeof(line), "r %lx %zu %lx\n", (unsigned long)oldPtr, size, (unsigned long)ptr);
+    appendLine(line, length);
+    pthread_mutex_unlock(&captureLock);
+    inCapture = 0;
+    return ptr;
+}
+
+EXPORT void free(void *ptr) {
+    if (ptr == NULL) return;
+    // Record before releasing so another thread cannot log a reuse of ptr first
+    if (!inCapture) record("f %lx\n", (unsigned long)ptr);
+    __libc_free(ptr);
+}
+
+EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+    if (ptr == NULL) return ENOMEM;
+    *memptr = ptr;
+    if (!inCapture) record("m %zu %lx\n", size, (unsigned long)ptr);
+    return 0;
+}
+
+EXPORT void *memalign(size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+    if (!inCapture) record("m %zu %lx\n", size, (unsigned long)ptr);
+    return ptr;
+}
+
+EXPORT void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
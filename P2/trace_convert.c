@@ -0,0 +1,244 @@
+// trace_convert.c
+// Description: Converts text malloc traces captured with libtracecapture.so
+//              into the binary trace format read by replay
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+
+#define  EMPTY_KEY        0
+
+/**
+* Data Structures
+*/
+
+// Live pointer table entry
+//  ptr - Address returned by the traced allocator, EMPTY_KEY if the slot is unused
+//  handle - Replay handle assigned to the live object
+typedef struct {
+    uint64_t ptr;
+    uint32_t handle;
+} LiveEntry;
+
+/**
+* Global Variables
+*/
+
+LiveEntry *liveTable = NULL;
+uint64_t liveCapacity = 0;
+uint64_t liveCount = 0;
+
+uint32_t *freeHandles = NULL;
+uint32_t nFreeHandles = 0;
+uint32_t freeHandlesCapacity = 0;
+uint32_t nHandles = 0;
+
+FILE *out;
+uint64_t nOps = 0;
+
+/**
+* Helper Functions
+*/
+
+/**
+* Hash Pointer
+* * Mixes the pointer bits so aligned addresses spread across the table
+* @param ptr pointer to hash
+* @return slot index in liveTable
+*/
+static uint64_t hashPointer(uint64_t ptr) {
+    ptr ^= ptr >> 33;
+    ptr *= 0xff51afd7ed558ccdull;
+    ptr ^= ptr >> 33;
+    return ptr & (liveCapacity - 1);
+}
+
+/**
+* Insert Live
+* * Inserts a pointer to handle mapping, growing the table at half load
+* @param ptr pointer returned by the traced allocator
+* @param handle handle assigned to the object
+*/
+void insertLive(uint64_t ptr, uint32_t handle) {
+    if (2 * (liveCount + 1) > liveCapacity) {
+        LiveEntry *oldTable = liveTable;
+        uint64_t oldCapacity = liveCapacity;
+        liveCapacity = oldCapacity ? 2 * oldCapacity : 1024;
+        liveTable = calloc(liveCapacity, sizeof(LiveEntry));
+        if (liveTable == NULL) exit(-1);
+        liveCount = 0;
+        for (uint64_t i = 0; i < oldCapacity; i++) {
+            if (oldTable[i].ptr != EMPTY_KEY) insertLive(oldTable[i].ptr, oldTable[i].handle);
+        }
+        free(oldTable);
+    }
+
+    uint64_t i = hashPointer(ptr);
+    while (liveTable[i].ptr != EMPTY_KEY) i = (i + 1) & (liveCapacity - 1);
+    liveTable[i].ptr = ptr;
+    liveTable[i].handle = handle;
+    liveCount++;
+}
+
+/**
+* Remove Live
+* * Removes a pointer from the live table, shifting back its probe chain
+* @param ptr pointer being freed
+* @return handle of the object, -1 if the pointer is not live
+*/
+int64_t removeLive(uint64_t ptr) {
+    if (liveCapacity == 0) return -1;
+    uint64_t i = hashPointer(ptr);
+    while (liveTable[i].ptr != ptr) {
+        if (liveTable[i].ptr == EMPTY_KEY) return -1;
+        i = (i + 1) & (liveCapacity - 1);
+    }
+    int64_t handle = liveTable[i].handle;
+    liveCount--;
+
+    // Backward shift deletion keeps every probe chain contiguous
+    uint64_t hole = i;
+    for (uint64_t j = (i + 1) & (liveCapacity - 1); liveTable[j].ptr != EMPTY_KEY; j = (j + 1) & (liveCapacity - 1)) {
+        uint64_t home = hashPointer(liveTable[j].ptr);
+        if (((j - home) & (liveCapacity - 1)) >= ((j - hole) & (liveCapacity - 1))) {
+            liveTable[hole] = liveTable[j];
+            hole = j;
+        }
+    }
+    liveTable[hole].ptr = EMPTY_KEY;
+    return handle;
+}
+
+/**
+* Take Handle
+* * Reuses the most recently released handle so the handle space stays dense
+* @return a handle not held by any live object
+*/
+uint32_t takeHandle(void) {
+    if (nFreeHandles > 0) return freeHandles[--nFreeHandles];
+    return nHandles++;
+}
+
+/**
+* Release Handle
+* * Returns a handle to the free handle stack
+* @param handle handle of the object just freed
+*/
+void releaseHandle(uint32_t handle) {
+    if (nFreeHandles == freeHandlesCapacity) {
+        freeHandlesCapacity = freeHandlesCapacity ? 2 * freeHandlesCapacity : 1024;
+        freeHandles = realloc(freeHandles, freeHandlesCapacity * sizeof(uint32_t));
+        if (freeHandles == NULL) exit(-1);
+    }
+    freeHandles[nFreeHandles++] = handle;
+}
+
+/**
+* Emit
+* * Writes one binary trace record
+* @param type OP_ALLOC or OP_FREE
+* @param handle handle of the object
+* @param size requested size for OP_ALLOC
+*/
+void emit(TraceOpType type, uint32_t handle, uint32_t size) {
+    TraceOp op;
+    memset(&op, 0, sizeof(op));
+    op.handle = handle;
+    op.size = size;
+    op.type = type;
+    fwrite(&op, sizeof(op), 1, out);
+    nOps++;
+}
+
+/**
+* Trace Alloc
+* * Emits the allocation of ptr, freeing a stale object at the same address first
+* @param size requested size
+* @param ptr pointer returned by the traced allocator
+*/
+void traceAlloc(uint64_t size, uint64_t ptr) {
+    int64_t stale = removeLive(ptr);
+    if (stale >= 0) {
+        emit(OP_FREE, stale, 0);
+        releaseHandle(stale);
+    }
+    uint32_t handle = takeHandle();
+    insertLive(ptr, handle);
+    emit(OP_ALLOC, handle, size > UINT32_MAX ? UINT32_MAX : size);
+}
+
+/**
+* Trace Free
+* * Emits the free of ptr if it is live
+* @param ptr pointer being freed
+* @return 0 if the pointer was live, -1 otherwise
+*/
+int traceFree(uint64_t ptr) {
+    int64_t handle = removeLive(ptr);
+    if (handle < 0) return -1;
+    emit(OP_FREE, handle, 0);
+    releaseHandle(handle);
+    return 0;
+}
+
+/**
+* Main Functions
+*/
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("Not enough parameters specified.  Usage: ./convert <capture_file> <trace_file>\n");
+        return -1;
+    }
+
+    FILE *in = fopen(argv[1], "r");
+    if (in == NULL) {
+        printf("Invalid input file specified: %s\n", argv[1]);
+        return -1;
+    }
+    out = fopen(argv[2], "wb");
+    if (out == NULL) {
+        printf("Invalid output file specified: %s\n", argv[2]);
+        return -1;
+    }
+
+    // Header is rewritten once the op and handle counts are known
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, out);
+
+    char line[256];
+    unsigned long lines = 0, skipped = 0, unmatchedFrees = 0;
+    while (fgets(line, sizeof(line), in)) {
+        unsigned long long a, b, c;
+        lines++;
+        if (line[0] == 'm' && sscanf(line + 1, "%llu %llx", &a, &b) == 2) {
+            // Failed allocations return NULL and leave nothing to replay
+            if (b != 0) traceAlloc(a, b);
+        } else if (line[0] == 'r' && sscanf(line + 1, "%llx %llu %llx", &a, &b, &c) == 3) {
+            // realloc(ptr, 0) frees, a failed realloc keeps the old object
+            if (c == 0 && b != 0) continue;
+            if (a != 0 && traceFree(a) < 0) unmatchedFrees++;
+            if (c != 0) traceAlloc(b, c);
+        } else if (line[0] == 'f' && sscanf(line + 1, "%llx", &a) == 1) {
+            if (traceFree(a) < 0) unmatchedFrees++;
+        } else {
+            skipped++;
+        }
+    }
+
+    memcpy(header.magic, TRACE_MAGIC, 4);
+    header.version = TRACE_VERSION;
+    header.nOps = nOps;
+    header.nHandles = nHandles;
+    fseek(out, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, out);
+    fclose(out);
+    fclose(in);
+
+    printf("Lines: %lu  Ops: %lu  Handles: %u  Live at exit: %lu  Unmatched frees: %lu  Skipped lines: %lu\n",
+        lines, (unsigned long)nOps, nHandles, (unsigned long)liveCount, unmatchedFrees, skipped);
+    return 0;
+}
@@ -0,0 +1,24 @@
+// 473_log.h
+// Description: Layout of the binary fault log written by project3.c and read by decode_log.c
+
+#ifndef _473_LOG_H
+#define _473_LOG_H
+
+#include <stdint.h>
+
+#define  LOG_MAGIC  0x4c333734  // "473L"
+
+// Header of a binary fault log. It is followed by the ring of 'slots' struct MM_stats
+// records, then by the 'slots' stamps of the ring, both as they were in memory.
+//  magic - LOG_MAGIC
+//  recordSize - sizeof(struct MM_stats) of the writer
+//  slots - Records the ring holds, the last 'slots' faults are kept
+//  count - Faults logged, fault i is in slot i % slots
+typedef struct {
+  uint32_t magic;
+  uint32_t recordSize;
+  uint64_t slots;
+  uint64_t count;
+} LogHeader;
+
+#endif
@@ -2,10 +2,34 @@
 #define _GNU_SOURCE 1
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <sys/mman.h>
 #include <signal.h>
+#include <x86intrin.h>
 #include "473_mm.h"
+#include "473_policy.h"
+#include "473_swap.h"
+#include "473_uffd.h"
+#include "473_ztier.h"
+
+#define  SPIN_TRIES  100
+#define  MAX_REGIONS  16
+#define  MAX_NODES  8
+#define  THROTTLE_US  200
+#define  UFFD_THREADS  64
+#define  MAX_ACCESS  64
+
+#ifndef MADV_COLLAPSE
+#define  MADV_COLLAPSE  25
+#endif
 
 /**
 * Data Structures
@@ -26,31 +50,120 @@ typedef enum {
 //  WriteRO - Write on a read-only page
 //  ReadRW - Read on a page that is RW (Only for page ref bit)
 //  WriteRW - Write on a page that is RW (Only for page write bit)
+//  Prefetch - Not a fault, a page read ahead, logged for the page it evicts
 typedef enum {
     ReadNPP  = 0,
     WriteNPP = 1,
     WriteRO  = 2,
     ReadRW   = 3,
-    WriteRW  = 4
+    WriteRW  = 4,
+    Prefetch = 5
 } pfFaultType;
 
-// Page info
-//  start - Start address of the page
-//  prev - Previous page in linked list
-//  next - Next page in linked list
-//  pageFrame - The frame number in physical memory, -1 if not
-//  readOnly - Flag set for when mprotect is in ReadOnly
-//  ref - The ref bit for the third chance replacement algorithm
-//  write - The 2-bit write field for the third chance replacement algorithm
-typedef struct Page {
+// Access pattern detector of the region, drives readahead
+//  lastPage - Virtual page of the last fault in the region
+//  stride - Distance between the last two faults
+//  streak - Number of consecutive faults at that stride
+//  window - Number of pages read ahead, between 1 and prefetchMax
+//  nextPage - Page past the last window, where the stream faults next if it used it
+typedef struct {
+    int lastPage;
+    int stride;
+    int streak;
+    int window;
+    int nextPage;
+} Readahead;
+
+// Huge page range, one for every run of base pages aligned to the huge page size
+//  present - Number of its base pages that hold a frame
+//  promoted - The range is mapped and tracked as one huge page
+typedef struct {
+    int present;
+    bool promoted;
+} HugeRange;
+
+// Frame allocation between regions
+//  ALLOC_GLOBAL - The policy picks victims from every frame
+//  ALLOC_EQUAL - Every region gets the same share of the frames
+//  ALLOC_PFF - Page fault frequency, a region gains a frame when it faults again within the
+//              window and gives up its unused pages when it does not
+//  ALLOC_WS - Working set, a region gets the pages it used in the last window
+typedef enum {
+    ALLOC_GLOBAL = 0,
+    ALLOC_EQUAL  = 1,
+    ALLOC_PFF    = 2,
+    ALLOC_WS     = 3
+} frameAlloc;
+
+// Region of memory managed as one process, region 0 is the one passed to mm_init
+//  start - First byte of the region
+//  size - Size of the region in bytes
+//  firstPage - Page table index of its first page
+//  nPages - Number of its pages
+//  resident - Number of its pages holding a frame
+//  target - Frames the allocation gives it
+//  demand - Its target when it was throttled
+//  faults - Faults on its non-present pages
+//  epochFaults - Those since the last thrashing check
+//  lastFault - Virtual time of its last fault on a non-present page
+//  hand - Page its clock resumes from when frames are taken from it
+//  throttled - Its faults are delayed while memory is overcommitted
+//  throttles - Number of times it was throttled
+typedef struct {
     char *start;
-    struct Page *prev;
-    struct Page *next;
-    int pageFrame;
-    bool readOnly;
-    bool ref;
-    ushort write : 2;
-} Page;
+    int size;
+    int firstPage;
+    int nPages;
+    int resident;
+    int target;
+    int demand;
+    unsigned long faults;
+    unsigned long epochFaults;
+    unsigned int lastFault;
+    int hand;
+    bool throttled;
+    unsigned long throttles;
+} Region;
+
+// Placement of pages on memory nodes
+//  NUMA_FIRST_TOUCH - On the node of the thread that faulted first
+//  NUMA_INTERLEAVE - On the nodes in turn along the virtual pages
+typedef enum {
+    NUMA_FIRST_TOUCH = 0,
+    NUMA_INTERLEAVE  = 1
+} nodePlacement;
+
+// Memory node, a run of frames numbered after those of the nodes added before it
+//  firstFrame - Its first frame
+//  nFrames - Number of its frames
+//  filled - Number of its frames handed out at least once, in order
+//  localNs - Modeled cost of an access from a thread of the node
+//  remoteNs - Modeled cost of an access from a thread of another node
+//  localAccesses - Faults that accessed its frames from its own threads
+//  remoteAccesses - Faults that accessed its frames from threads of other nodes
+//  hand - Frame its clock resumes from when a migration needs room
+typedef struct {
+    int firstFrame;
+    int nFrames;
+    int filled;
+    int localNs;
+    int remoteNs;
+    unsigned long localAccesses;
+    unsigned long remoteAccesses;
+    int hand;
+} NumaNode;
+
+// Fault history of one thread, for the policies that track references
+//  tid - Thread id, 0 for a free slot of the userfaultfd engine's table
+//  lastAddr, prevAddr - Addresses of the thread's last two faults
+//  tracked - Page of the thread's last fault, then the page before it if a retried fault
+//            needs both, still accessible
+typedef struct {
+    int tid;
+    char *lastAddr;
+    char *prevAddr;
+    Page *tracked[2];
+} FaultThread;
 
 /**
 * Global Variables
@@ -63,293 +176,2133 @@ int pageSize = -1;
 int pFrames = -1;
 
 int activePages = 0;
-int clockIndex = 0;
+int *freeFrames = NULL;
+int nFreeFrames = 0;
+
+// Region 0 is filled in by mm_init, the others by mm_add_region
+Region regions[MAX_REGIONS];
+int nRegions = 1;
+int allocMode = ALLOC_GLOBAL;
+int allocWindow = 0;
+int faultsSinceSample = 0;
+int faultsSinceCheck = 0;
+
+Page *pageTable = NULL;
+int nPages = 0;
+Frame *frameTable = NULL;
+
+const MMPolicy *mmPolicyOps = NULL;
+MMContext mmContext;
+
+const char *swapPath = NULL;
+long tierBytes = 0;
+
+// Never written pages read through the zero frame, and frames shared copy-on-write.
+// frameSharers holds the first page sharing each frame besides its owner, nextSharer
+// links the others, both -1 at the end.
+bool zeroPageEnabled = false;
+int *frameSharers = NULL;
+int *nextSharer = NULL;
+char *cowBuffer = NULL;
+int memFd = -1;
+unsigned long zeroMaps = 0;
+unsigned long sharedPages = 0;
+unsigned long cowCopies = 0;
+unsigned long sharedEvictions = 0;
+bool uffdEnabled = false;
 
-Page *pageListHead = NULL;
-Page *pageListTail = NULL;
+// Held while the frame table, the policy state or the readahead state change.
+// A thread holding it may wait for a page lock, so a thread holding a page
+// lock only waits for it when the page is not present.
+volatile char pagerLock = 0;
+volatile char logLock = 0;
+
+bool cleanerEnabled = false;
+int cleanerLow = -1;
+int cleanerHigh = -1;
+int cleanerInterval = -1;
+sem_t cleanerWake;
+pthread_t cleanerThread;
+unsigned long cleanedPages = 0;
+
+// Readahead is off while prefetchMax is 0
+int prefetchMax = 0;
+Readahead stream = {-1, 0, 0, 0, -1};
+unsigned long prefetchIssued = 0;
+unsigned long prefetchHits = 0;
+unsigned long prefetchWasted = 0;
+
+// Frames are split between memory nodes once any is added. frameNodes holds the node of
+// every frame, remoteStreaks the faults in a row each page took from another node.
+NumaNode numaNodes[MAX_NODES];
+int nNumaNodes = 0;
+int numaPlacement = NUMA_FIRST_TOUCH;
+int numaMigrateAfter = 0;
+unsigned char *frameNodes = NULL;
+unsigned char *remoteStreaks = NULL;
+int nextThreadNode = 0;
+__thread int threadNode = -1;
+unsigned long numaMisplaced = 0;
+unsigned long numaMigrations = 0;
+
+// Modeled I/O costs, and the write back budget, off while writeBudget is 0. writeTokens
+// holds the write backs the budget still allows, negative once faults ran past it.
+int readCostUs = DEFAULT_READ_US;
+int writeCostUs = DEFAULT_WRITE_US;
+int writeBudget = 0;
+double writeTokens = 0;
+struct timespec tokenTime;
+unsigned long pageIns = 0;
+unsigned long throttledWrites = 0;
+unsigned long throttledUs = 0;
+
+// Fault history of every thread under SIGSEGV, and of the threads of the userfaultfd
+// engine by thread id, only read and written by its fault thread
+__thread FaultThread signalThread;
+FaultThread uffdThreads[UFFD_THREADS];
+
+// Counters behind the mm_report functions
+unsigned long faultCounts[5] = {0};
+unsigned long evictions = 0;
+unsigned long writeBacks = 0;
+unsigned long latencyHistogram[LATENCY_BUCKETS] = {0};
+unsigned long spuriousFaults = 0;
+unsigned long protectCalls = 0;
+
+// Pages the policies asked to protect, protected together every sweepInterval faults
+int *pendingPages = NULL;
+int pendingCount = 0;
+int sweepInterval = 1;
+int faultsSinceSweep = 0;
+
+// Huge pages are off while hugeSize is -1
+int hugeSize = -1;
+int hugePages = 0;
+int hugeFirst = 0;
+int nHugeRanges = 0;
+HugeRange *hugeRanges = NULL;
+bool hugeCollapse = false;
+int hugeMapped = 0;
+unsigned long promotions = 0;
+unsigned long demotions = 0;
+unsigned long collapses = 0;
+struct timespec initTime;
 
 /**
 * Helper Functions
 */
 
 /**
-* Find Page
-* * Finds the page pointer from available pages given page start address
-* @param pageStart the start address of the page
+* Region Of
+* * Finds the region holding a page, regions are laid out in order in the page table
+* @param page the page table entry
 */
-Page *findPage(void *pageStart) {
-    Page *tempPage = malloc(sizeof(struct Page));
-    tempPage->start = pageStart;
-    tempPage->prev = NULL;
-    tempPage->next = NULL;
-    tempPage->pageFrame = -1;
-    tempPage->readOnly = 0;
-    tempPage->ref = 0;
-    tempPage->write = 0;
+static inline Region *regionOf(Page *page) {
+    int number = page - pageTable;
+    int region = nRegions - 1;
+    while (number < regions[region].firstPage) region--;
+    return &regions[region];
+}
 
-    // Search through linked list for the page
-    Page *nextPage = pageListHead;
-    while (nextPage != NULL) {
-        if (nextPage->start == pageStart) {
-            free(tempPage);
-            return nextPage;
-        }
-        nextPage = nextPage->next;
+/**
+* Page Start
+* * Finds the start address of a page from its page table entry
+* @param page the page table entry
+*/
+static inline char *pageStart(Page *page) {
+    Region *region = regionOf(page);
+    return region->start + (size_t)(page - pageTable - region->firstPage) * pageSize;
+}
+
+/**
+* Page Number
+* * Finds the virtual page number of a page table entry
+* @param page the page table entry
+*/
+static inline int pageNumber(Page *page) {
+    return page - pageTable;
+}
+
+/**
+* Spin Lock
+* * Spins until a lock is taken, safe to use in the signal handler. Yields the CPU
+* * after a while, as the holder may be waiting for it.
+* @param lock the lock
+*/
+static void spinLock(volatile char *lock) {
+    while (__atomic_test_and_set(lock, __ATOMIC_ACQUIRE)) {
+        for (int i = 0; i < SPIN_TRIES && __atomic_load_n(lock, __ATOMIC_RELAXED); i++) __builtin_ia32_pause();
+        if (__atomic_load_n(lock, __ATOMIC_RELAXED)) sched_yield();
     }
+}
+
+/**
+* Lock Pager
+* * Takes the pager lock
+*/
+static inline void lockPager(void) {
+    spinLock(&pagerLock);
+}
+
+static inline void unlockPager(void) {
+    __atomic_clear(&pagerLock, __ATOMIC_RELEASE);
+}
+
+/**
+* Lock Page
+* * Spins until the lock of a page is taken
+* @param page the page table entry
+*/
+static inline void lockPage(Page *page) {
+    spinLock(&page->lock);
+}
+
+static inline bool tryLockPage(Page *page) {
+    return !__atomic_test_and_set(&page->lock, __ATOMIC_ACQUIRE);
+}
 
-    return tempPage;
+static inline void unlockPage(Page *page) {
+    __atomic_clear(&page->lock, __ATOMIC_RELEASE);
 }
 
 /**
-* Enque Page
-* * Enques the provided page to the end of page queue
-* @param page the page to be queued
+* Set Protection
+* * Changes the protection of a present page, tracking whether it is accessible and
+* * writable. Caller must hold the page lock.
+* @param page the page table entry
+* @param prot the new protection
 */
-void enquePage(Page *page) {
-    if (pageListHead == NULL) {
-        pageListHead = page;
-        pageListTail = page;
+static void setProtection(Page *page, int prot) {
+    // Pages without access are already protected
+    if (prot == PROT_NONE && !(page->flags & PTE_MAPPED)) return;
+    __atomic_fetch_add(&protectCalls, 1, __ATOMIC_RELAXED);
+    if (uffdEnabled) {
+        uffdSetProtection(pageStart(page), pageNumber(page), prot,
+                          page->flags & PTE_MAPPED, page->flags & PTE_WRITABLE);
+    } else {
+        mprotect(pageStart(page), pageSize, prot);
+    }
+    if (prot != PROT_NONE) {
+        pteSet(page, PTE_MAPPED);
+    } else {
+        pteClear(page, PTE_MAPPED);
+    }
+    if (prot & PROT_WRITE) {
+        pteSet(page, PTE_WRITABLE);
     } else {
-        page->prev = pageListTail;
-        pageListTail->next = page;
-        pageListTail = page;
+        pteClear(page, PTE_WRITABLE);
     }
 }
 
 /**
-* Evict Page
-* * Evicts the provided page from the page queue
-* @param page the page to be evicted
+* Range Of
+* * Finds the huge page range holding a page
+* @param page the page table entry
+* @return the range number, -1 if the page is in no whole aligned range
 */
-void evictPage(Page *page) {
-    if (page->prev == NULL) {
-        pageListHead = page->next;
-    } else {
-        page->prev->next = page->next;
+static int rangeOf(Page *page) {
+    if (hugeSize == -1) return -1;
+    int offset = pageNumber(page) - hugeFirst;
+    if (offset < 0 || offset / hugePages >= nHugeRanges) return -1;
+    return offset / hugePages;
+}
+
+static inline Page *rangePage(int range, int i) {
+    return &pageTable[hugeFirst + range * hugePages + i];
+}
+
+/**
+* Lock Range
+* * Takes the lock of every page of a range but one the caller already holds
+* @param range the range
+* @param held the page of the range whose lock the caller holds, NULL if none
+* @param wait spin for held locks instead of giving up
+* @return true if every lock was taken, false if none is held
+*/
+static bool lockRange(int range, Page *held, bool wait) {
+    for (int i = 0; i < hugePages; i++) {
+        Page *page = rangePage(range, i);
+        if (page == held) continue;
+        if (wait) {
+            lockPage(page);
+        } else if (!tryLockPage(page)) {
+            while (i-- > 0) {
+                if (rangePage(range, i) != held) unlockPage(rangePage(range, i));
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+static void unlockRange(int range, Page *held) {
+    for (int i = 0; i < hugePages; i++) {
+        if (rangePage(range, i) != held) unlockPage(rangePage(range, i));
+    }
+}
+
+/**
+* Set Range Protection
+* * Changes the protection of every page of a range with one mprotect. Caller must
+* * hold their locks.
+* @param range the range
+* @param prot the new protection
+*/
+static void setRangeProtection(int range, int prot) {
+    if (uffdEnabled) {
+        for (int i = 0; i < hugePages; i++) setProtection(rangePage(range, i), prot);
+        return;
+    }
+    mprotect(pageStart(rangePage(range, 0)), hugeSize, prot);
+    __atomic_fetch_add(&protectCalls, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < hugePages; i++) {
+        Page *page = rangePage(range, i);
+        if (prot != PROT_NONE) {
+            pteSet(page, PTE_MAPPED);
+        } else {
+            pteClear(page, PTE_MAPPED);
+        }
+        if (prot & PROT_WRITE) {
+            pteSet(page, PTE_WRITABLE);
+        } else {
+            pteClear(page, PTE_WRITABLE);
+        }
+    }
+}
+
+/**
+* Try Promote
+* * Promotes a range to a huge page once every base page of it is present and
+* * referenced. The range is then mapped with one protection, and if any page of it
+* * was written, it is writable and dirty as a whole. Skipped while another thread
+* * holds one of its pages. Caller must hold the pager lock.
+* @param range the range
+* @param held the page of the range whose lock the caller holds, NULL if none
+*/
+static void tryPromote(int range, Page *held) {
+    HugeRange *huge = &hugeRanges[range];
+    if (huge->promoted || huge->present < hugePages) return;
+    bool dirty = false;
+    for (int i = 0; i < hugePages; i++) {
+        Page *page = rangePage(range, i);
+        if ((page->flags & (PTE_REF | PTE_PREFETCHED | PTE_PENDING)) != PTE_REF) return;
+        if (getWrite(page) & 1) dirty = true;
+    }
+    if (!lockRange(range, held, false)) return;
+
+    for (int i = 0; i < hugePages; i++) {
+        Page *page = rangePage(range, i);
+        pteSet(page, PTE_HUGE);
+        if (dirty) {
+            pteSet(page, PTE_DATA);
+            pteClear(page, PTE_READONLY);
+            setWrite(page, 3);
+        }
+    }
+    setRangeProtection(range, dirty ? PROT_READ | PROT_WRITE : PROT_READ);
+    huge->promoted = true;
+    hugeMapped++;
+    promotions++;
+
+    // Have the kernel back the range with a transparent huge page now, if it can
+    if (hugeCollapse && madvise(pageStart(rangePage(range, 0)), hugeSize, MADV_COLLAPSE) == 0) collapses++;
+    unlockRange(range, held);
+}
+
+/**
+* Demote
+* * Splits a promoted range back into base pages, which keep their frames and
+* * protection. Caller must hold the pager lock.
+* @param range the range
+*/
+static void demote(int range) {
+    for (int i = 0; i < hugePages; i++) pteClear(rangePage(range, i), PTE_HUGE);
+    hugeRanges[range].promoted = false;
+    hugeMapped--;
+    demotions++;
+}
+
+/**
+* Handle Huge Fault
+* * Grants access to a whole promoted range on a fault on any of its pages. Every page
+* * of it is marked referenced, and written on a write, like the accessed and dirty
+* * bits of a huge page table entry. Caller must hold the pager lock and the page lock.
+* @param page the page that faulted
+* @param write true if the access was a write
+* @return the fault type
+*/
+static pfFaultType handleHugeFault(Page *page, bool write) {
+    int range = rangeOf(page);
+    pfFaultType cause = !write ? ReadRW : (page->flags & PTE_MAPPED) ? WriteRO : WriteRW;
+    lockRange(range, page, true);
+    for (int i = 0; i < hugePages; i++) {
+        Page *rangePageEntry = rangePage(range, i);
+        pteSet(rangePageEntry, PTE_REF);
+        if (write) {
+            pteSet(rangePageEntry, PTE_DATA);
+            pteClear(rangePageEntry, PTE_READONLY);
+            setWrite(rangePageEntry, 3);
+        }
     }
+    setRangeProtection(range, write ? PROT_READ | PROT_WRITE : PROT_READ);
+    unlockRange(range, page);
+    return cause;
+}
 
-    if (page->next == NULL) {
-        pageListTail = page->prev;
+/**
+* Protect Run
+* * Revokes all access to a run of consecutive pages whose locks are held, with one
+* * mprotect, then releases them
+* @param first virtual page number of the first page
+* @param length number of pages in the run
+*/
+static void protectRun(int first, int length) {
+    if (length == 0) return;
+    if (uffdEnabled) {
+        // Each page is saved and dropped on its own
+        for (int i = first; i < first + length; i++) setProtection(&pageTable[i], PROT_NONE);
     } else {
-        page->next->prev = page->prev;
+        mprotect(pageStart(&pageTable[first]), length * pageSize, PROT_NONE);
+        __atomic_fetch_add(&protectCalls, 1, __ATOMIC_RELAXED);
+    }
+    for (int i = first; i < first + length; i++) {
+        pteClear(&pageTable[i], PTE_MAPPED | PTE_WRITABLE);
+        unlockPage(&pageTable[i]);
     }
+}
 
-    // Set page as independent item
-    page->prev = NULL;
-    page->next = NULL;
+/**
+* Sort Pages
+* * Sorts page numbers in place with heapsort, which needs no memory
+* @param pages the page numbers
+* @param count number of page numbers
+*/
+static void sortPages(int *pages, int count) {
+    for (int end = count; end > 1; end--) {
+        // Heapify once, then move the largest page to the end each pass
+        for (int root = (end == count ? end / 2 - 1 : 0); root >= 0; root--) {
+            int parent = root;
+            while (2 * parent + 1 < end) {
+                int child = 2 * parent + 1;
+                if (child + 1 < end && pages[child + 1] > pages[child]) child++;
+                if (pages[parent] >= pages[child]) break;
+                int swap = pages[parent];
+                pages[parent] = pages[child];
+                pages[child] = swap;
+                parent = child;
+            }
+        }
+        int swap = pages[0];
+        pages[0] = pages[end - 1];
+        pages[end - 1] = swap;
+    }
 }
 
 /**
-* Reset Page
-* * Sets page to default values of a new temp page
-* @param page the page to be reset
+* Flush Protections
+* * Protects the pages the policies asked for, one mprotect per run of consecutive pages.
+* * Pages evicted since were protected by the eviction, and a page whose lock is held is
+* * being faulted on, so it is in use and left as it is. Caller must hold the pager lock.
 */
-void resetPage(Page *page) {
-    // Reset the page
-    page->prev = NULL;
-    page->next = NULL;
-    page->pageFrame = -1;
-    page->readOnly = 0;
-    page->ref = 0;
-    page->write = 0;
+static void flushProtections(void) {
+    sortPages(pendingPages, pendingCount);
+    int first = 0;
+    int length = 0;
+    for (int i = 0; i < pendingCount; i++) {
+        Page *page = &pageTable[pendingPages[i]];
+        if (!(page->flags & PTE_PENDING)) continue;
+        pteClear(page, PTE_PENDING);
+        if (!tryLockPage(page)) continue;
+        // Regions are not adjacent in memory, so a run ends at the end of its region
+        if (length > 0 && (pendingPages[i] != first + length || regionOf(page) != regionOf(&pageTable[first]))) {
+            protectRun(first, length);
+            length = 0;
+        }
+        if (length == 0) first = pendingPages[i];
+        length++;
+    }
+    protectRun(first, length);
+    pendingCount = 0;
+}
+
+/**
+* Queue Protection
+* * Queues a page for the next reference sample, sampling early if the queue is full
+* @param page the page to protect
+*/
+static void queueProtection(Page *page) {
+    if (page->flags & PTE_PENDING) return;
+    pteSet(page, PTE_PENDING);
+    pendingPages[pendingCount++] = pageNumber(page);
+    if (pendingCount == pFrames) flushProtections();
+}
 
-    // Protect the page
-    mprotect(page->start, pageSize, PROT_NONE);
+/**
+* Protect Page
+* * The policies' protect callback, which queues a page for the next reference sample
+* @param ctx the context
+* @param page the page to protect
+*/
+static void protectPage(MMContext *ctx, Page *page) {
+    // A page read ahead has no reference to sample yet, readAhead sees when it is used
+    if (page->flags & PTE_PREFETCHED) return;
+    if (page->flags & PTE_HUGE) {
+        // A huge page is referenced as a whole, so it is protected as a whole
+        int range = rangeOf(page);
+        for (int i = 0; i < hugePages; i++) queueProtection(rangePage(range, i));
+        return;
+    }
+    queueProtection(page);
 }
 
 /**
-* Main Functions
+* Sample References
+* * Called once a fault is done with the policy, protects the queued pages every
+* * sweepInterval faults. Caller must hold the pager lock.
 */
+static void sampleReferences(void) {
+    if (++faultsSinceSweep < sweepInterval) return;
+    faultsSinceSweep = 0;
+    if (pendingCount > 0) flushProtections();
+}
 
 /**
-* Page Fault Handler
-* * Handles a page fault which generates a SIGSEGV signal
-* @param sig 
-* @param sigInfo
-* @param context
+* Refill Write Tokens
+* * Adds the write backs the budget allowed since the last refill, keeping at most a tenth
+* * of a second's worth so that idle time builds no burst. Caller must hold the pager lock.
+* @return the write backs the budget allows now
 */
-static void pfHandler(int sig, siginfo_t *sigInfo, void *context) {
-    char *addr = (char *)sigInfo->si_addr;
-    bool write = ((ucontext_t *)context)->uc_mcontext.gregs[REG_ERR] & (PF_WRITE);
+static double refillWriteTokens(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    writeTokens += ((now.tv_sec - tokenTime.tv_sec) + (now.tv_nsec - tokenTime.tv_nsec) / 1e9) * writeBudget;
+    tokenTime = now;
+    double burst = writeBudget / 10 > 1 ? writeBudget / 10 : 1;
+    if (writeTokens > burst) writeTokens = burst;
+    return writeTokens;
+}
 
-    // Check if address is in range of allocated memory
-    if ((char *)addr > ((char *)start + size - 1) || (char *)addr < (char *)start) exit(SIGSEGV);
+/**
+* Charge Write Back
+* * Takes a write back off the budget, if there is one. Caller must hold the pager lock.
+*/
+static void chargeWriteBack(void) {
+    if (writeBudget == 0) return;
+    refillWriteTokens();
+    writeTokens--;
+}
 
-    int virtualPage = (addr - start) / pageSize;
-    int pageOffet = (addr - start) % pageSize;
-    char *startAddr = start + (virtualPage * pageSize);
+/**
+* Write Wait
+* * Gives the time a fault that wrote a page back waits for the budget to allow it, which
+* * is the time the budget takes to pay off the write backs charged past it. Caller must
+* * hold the pager lock.
+* @return microseconds to wait once the locks are released, 0 if the budget allowed it
+*/
+static long writeWait(void) {
+    if (writeBudget == 0 || writeTokens >= 0) return 0;
+    long us = (long)(-writeTokens * 1000000 / writeBudget);
+    throttledWrites++;
+    throttledUs += us;
+    return us;
+}
 
-    Page *pfPage = findPage(startAddr);
+/**
+* Sleep Us
+* * Holds the calling thread back, with no lock held
+* @param us microseconds to sleep
+*/
+static void sleepUs(long us) {
+    struct timespec delay = {us / 1000000, (us % 1000000) * 1000};
+    nanosleep(&delay, NULL);
+}
 
-    // Determine if the page is a new page
-    bool newPage = false;
-    if (pfPage->prev == NULL && pfPage->pageFrame == -1 && pfPage->next == NULL) newPage = true;
+/**
+* Clean Page
+* * Writes a dirty page back early and write-protects it, so its next write faults
+* * and marks it dirty again. Caller must hold the pager lock and the page lock.
+* @param page the dirty page
+*/
+static void cleanPage(Page *page) {
+    if (page->flags & PTE_WRITABLE) setProtection(page, PROT_READ);
+    pteSet(page, PTE_READONLY);
+    if (swapPath != NULL) {
+        swapQueueWrite(pageNumber(page), page->pageFrame);
+        pteSet(page, PTE_SWAPPED);
+    }
+    setWrite(page, 0);
+    cleanedPages++;
+    chargeWriteBack();
+}
 
-    // Detemine cause of page fault
-    bool writeBack = false;
-    int evictedPage = -1;
-    pfFaultType cause;
-    if (pfPage->pageFrame == -1) {
-        // Page not present
-        if (!write) {
-            cause = ReadNPP;
-            pfPage->readOnly = 1;
-            pfPage->ref = 1;
-            mprotect(pfPage->start, pageSize, PROT_READ);
-        } else {
-            cause = WriteNPP;
-            pfPage->ref = 1;
-            pfPage->write = 3;
-            mprotect(pfPage->start, pageSize, PROT_READ | PROT_WRITE);
+/**
+* Cleaner
+* * Wakes every interval, or when a dirty page was evicted, and once more than the high
+* * watermark of frames are dirty cleans frames ahead of the policy's hand until no more
+* * than the low watermark are. The pager lock is taken for one frame at a time, so
+* * faults go on during a sweep. It only spends write backs the budget has left, so faults
+* * that must write back keep the rest.
+* @param arg unused
+*/
+static void *cleaner(void *arg) {
+    while (true) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)cleanerInterval * 1000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        sem_timedwait(&cleanerWake, &deadline);
+
+        lockPager();
+        int dirty = 0;
+        int hand = mmContext.hand;
+        for (int frame = 0; frame < activePages; frame++) {
+            // Frames the frame allocation freed hold no page
+            if (frameTable[frame].page != NULL && (getWrite(frameTable[frame].page) & 1)) dirty++;
         }
-    } else {
-        // Page present, no page placement necessary
-        if (pfPage->readOnly && write) {
-            cause = WriteRO;
-            pfPage->readOnly = false;
-            pfPage->ref = 1;
-            pfPage->write = 3;
-            mprotect(pfPage->start, pageSize, PROT_READ | PROT_WRITE);
-        } else {
-            // Should only be triggered in mmPolicy == 2
-            if (!write) {
-                cause = ReadRW;
-                pfPage->ref = 1;
-                mprotect(pfPage->start, pageSize, PROT_READ);
-            } else {
-                cause = WriteRW;
-                pfPage->ref = 1;
-                pfPage->write = 3;
-                mprotect(pfPage->start, pageSize, PROT_READ | PROT_WRITE);
+        unlockPager();
+        if (dirty * 100 <= cleanerHigh * pFrames) continue;
+
+        for (int i = 0; i < pFrames && dirty * 100 > cleanerLow * pFrames; i++) {
+            lockPager();
+            bool allowed = writeBudget == 0 || refillWriteTokens() >= 1;
+            Page *page = frameTable[(hand + i) % pFrames].page;
+            if (allowed && page != NULL && (getWrite(page) & 1) && !(page->flags & PTE_HUGE)) {
+                lockPage(page);
+                cleanPage(page);
+                unlockPage(page);
+                dirty--;
             }
+            unlockPager();
+            if (!allowed) break;
         }
-        mm_logger(virtualPage, cause, evictedPage, writeBack, (pfPage->pageFrame * pageSize) + pageOffet);
-        return;
     }
+    return NULL;
+}
 
-    if (activePages < pFrames) {
-        // Not all physical frames are filled
-        pfPage->pageFrame = activePages++;
-        enquePage(pfPage);
+/**
+* Unlink Sharer
+* * Takes a page off the list of pages sharing its frame, and clears PTE_SHARED from the
+* * frame's owner once no other page shares it. Caller must hold the pager lock.
+* @param page a sharer of a frame
+*/
+static void unlinkSharer(Page *page) {
+    int frame = page->pageFrame;
+    int *link = &frameSharers[frame];
+    while (*link != pageNumber(page)) link = &nextSharer[*link];
+    *link = nextSharer[pageNumber(page)];
+    pteClear(page, PTE_SHARED);
+    if (frameSharers[frame] == -1) pteClear(frameTable[frame].page, PTE_SHARED);
+}
+
+/**
+* Drop Sharers
+* * Unmaps every page sharing a frame besides its owner, before the owner is evicted. The
+* * frame is each one's only copy, so with a swap file it is written out like a dirty page.
+* * Caller must hold the pager lock.
+* @param frame the frame
+*/
+static void dropSharers(int frame) {
+    while (frameSharers[frame] != -1) {
+        Page *sharer = &pageTable[frameSharers[frame]];
+        lockPage(sharer);
+        frameSharers[frame] = nextSharer[pageNumber(sharer)];
+        if (swapPath != NULL) {
+            swapPageOut(pageStart(sharer), pageNumber(sharer), frame, true);
+            pteSet(sharer, PTE_SWAPPED);
+            pteClear(sharer, PTE_MAPPED | PTE_WRITABLE);
+        } else {
+            setProtection(sharer, PROT_NONE);
+        }
+        sharer->pageFrame = -1;
+        pteClear(sharer, PTE_SHARED);
+        sharedEvictions++;
+        unlockPage(sharer);
+    }
+}
+
+/**
+* Evict Page
+* * Takes the frame from the page a policy picked as victim, waiting for a thread
+* * handling a fault on it. Caller must hold the pager lock.
+* @param page the page to evict
+* @return true if the page was dirty and needs writing back
+*/
+static bool evictPage(Page *page) {
+    lockPage(page);
+    if (page->flags & PTE_SHARED) dropSharers(page->pageFrame);
+    bool writeBack = (getWrite(page) & 1) > 0;
+    if (swapPath != NULL) {
+        swapPageOut(pageStart(page), pageNumber(page), page->pageFrame, writeBack);
+        if (writeBack) pteSet(page, PTE_SWAPPED);
     } else {
-        int pageFrame = -1;
-        if (mmPolicy == 1) {
-            // Do FIFO replacement
-            // Find new page frame and evict oldest page
-            Page *nextPage = pageListHead;
-            while (nextPage != NULL) {
-                if (nextPage->pageFrame > -1) {
-                    // Evict the candidate page
-                    evictPage(nextPage);
-
-                    // Determine logger values
-                    pageFrame = nextPage->pageFrame;
-                    evictedPage = ((nextPage->start) - start) / pageSize;
-                    if (nextPage->write > 0) writeBack = true;
-                    resetPage(nextPage);
-
-                    // Re-enque the page
-                    enquePage(nextPage);
-                    break;
-                }
-                // Shouldn't ever run since head will always be next item
-                nextPage = nextPage->next;
-            }
-            
-            // Set page frame and re-enque page
-            pfPage->pageFrame = pageFrame;
-            if (!newPage) evictPage(pfPage);
-            enquePage(pfPage);
-        } else if (mmPolicy == 2) {
-            // Do third chance replacement
-            bool pageEviction = false;
-
-            // Loop until a page is evicted
-            while (pageEviction == false) {
-                // Determine first page in cycle
-                Page *nextPage = pageListHead;
-                for (int i = 0; i < clockIndex; i++) {
-                    nextPage = nextPage->next;
-                }
-
-                // Loop until the end of the list
-                while (nextPage != NULL) {
-                    clockIndex++;
-                    // Update current page
-                    if (nextPage->pageFrame > -1) {
-                        // Make sure the page is protected so we can
-                        // Update clock bits for third chance cycle
-                        mprotect(nextPage->start, pageSize, PROT_NONE);
-
-                        // Check first chance
-                        if (nextPage->ref == 1) {
-                            // First chance, check reference bit
-                            nextPage->ref = 0;
-                        } else if ((nextPage->write & 1 << 1) > 0) {
-                            // Second chance, check write first bit
-                            nextPage->write = 1;
-                        } else {
-                            // Evict current page
-                            pageEviction = true;
-                            evictedPage = ((nextPage->start) - start) / pageSize;
-                            pageFrame = nextPage->pageFrame;
-                            nextPage->pageFrame = -1;
-
-                            // Check second write bit to determine writeback
-                            if ((nextPage->write & 1 << 0) > 0) {
-                                nextPage->write = 0;
-                                writeBack = true;
-                            } else {
-                                writeBack = false;
-                            }
-
-                            break;
-                        }
-                    }
-
-                    nextPage = nextPage->next;
-                }
-
-                //  Check if loop needs to continue cycle
-                if (!pageEviction || nextPage->next == NULL) clockIndex = 0;
-            }
+        setProtection(page, PROT_NONE);
+    }
+    evictions++;
+    if (writeBack) {
+        writeBacks++;
+        chargeWriteBack();
+    }
+    if (page->flags & PTE_PREFETCHED) {
+        // Read ahead for nothing, the stream was shorter than the window
+        prefetchWasted++;
+        if (stream.window > 1) stream.window /= 2;
+    }
+    int range = rangeOf(page);
+    if (range != -1) hugeRanges[range].present--;
+    regionOf(page)->resident--;
+    page->pageFrame = -1;
+    pteClear(page, ~(PTE_READONLY | PTE_QUEUED | PTE_SWAPPED | PTE_DATA | PTE_USED));
+    unlockPage(page);
+    if (writeBack && cleanerEnabled) sem_post(&cleanerWake);
+    return writeBack;
+}
+
+/**
+* Release Page
+* * Evicts a present page the policy did not pick and frees its frame. Caller must hold the
+* * pager lock.
+* @param page the page to evict
+* @return true if the page was dirty and needed writing back
+*/
+static bool releasePage(Page *page) {
+    int frame = page->pageFrame;
+    if (mmPolicyOps->release != NULL) mmPolicyOps->release(&mmContext, page);
+    if (page->flags & PTE_HUGE) demote(rangeOf(page));
+    bool writeBack = evictPage(page);
+    frameTable[frame].page = NULL;
+    freeFrames[nFreeFrames++] = frame;
+    return writeBack;
+}
+
+/**
+* Donor Region
+* * Picks the region that gives up a frame for a page once every frame is full. A region
+* * at its target gives up one of its own, one below it takes one from the region furthest
+* * above its own target.
+* @param page the page that needs a frame
+* @return the region, NULL to leave the choice to the policy
+*/
+static Region *donorRegion(Page *page) {
+    if (allocMode == ALLOC_GLOBAL) return NULL;
+    Region *region = regionOf(page);
+    if (region->resident >= region->target && region->resident > 0) return region;
+    Region *donor = NULL;
+    for (int i = 0; i < nRegions; i++) {
+        int over = regions[i].resident - regions[i].target;
+        if (over > 0 && (donor == NULL || over > donor->resident - donor->target)) donor = &regions[i];
+    }
+    return donor;
+}
+
+/**
+* Region Clock
+* * Second chance over the pages of one region. Referenced pages lose their ref bit and
+* * are protected, so their next reference sets it again. Caller must hold the pager lock.
+* @param region a region with a present page
+* @return the page to evict
+*/
+static Page *regionClock(Region *region) {
+    while (true) {
+        Page *page = &pageTable[region->firstPage + region->hand];
+        region->hand = (region->hand + 1) % region->nPages;
+        if (!(page->flags & PTE_PRESENT)) continue;
+        if (page->flags & PTE_REF) {
+            pteClear(page, PTE_REF);
+            protectPage(&mmContext, page);
+            continue;
+        }
+        return page;
+    }
+}
+
+/**
+* Sample Region
+* * Counts the pages of a region used since the last sample, resident or evicted since,
+* * and protects the resident ones, so their next reference marks them used again. With
+* * releaseUnused, resident pages not used since are evicted instead. Caller must hold
+* * the pager lock.
+* @param region the region
+* @param releaseUnused evict the pages not used since the last sample
+* @return the number of pages used since the last sample, its working set
+*/
+static int sampleRegion(Region *region, bool releaseUnused) {
+    int used = 0;
+    for (int i = 0; i < region->nPages; i++) {
+        Page *page = &pageTable[region->firstPage + i];
+        if (page->flags & PTE_USED) {
+            // A page evicted since it faulted is still in the working set, or the set could
+            // never grow past the frames the region holds
+            used++;
+            pteClear(page, PTE_USED);
+            if (page->flags & PTE_PRESENT) protectPage(&mmContext, page);
+        } else if (releaseUnused && (page->flags & PTE_PRESENT)) {
+            releasePage(page);
+        }
+    }
+    return used;
+}
+
+/**
+* Check Thrashing
+* * Regions that together want more frames than there are keep taking them from each
+* * other. The region with the most faults since the last check is then throttled and its
+* * target dropped to one frame, so its pages go to the others. Throttling lasts until the
+* * next check, so regions that cannot all fit take turns. Caller must hold the pager lock.
+*/
+static void checkThrashing(void) {
+    int demand = 0;
+    Region *worst = NULL;
+    for (int i = 0; i < nRegions; i++) {
+        Region *region = &regions[i];
+        if (region->throttled) {
+            region->throttled = false;
+            region->target = region->demand;
+        }
+        demand += region->target;
+        // A region just resumed faulted little while throttled, so another one goes next
+        if (worst == NULL || region->epochFaults > worst->epochFaults) worst = region;
+    }
+    if (demand > pFrames && nRegions > 1) {
+        worst->throttled = true;
+        worst->throttles++;
+        worst->demand = worst->target;
+        worst->target = 1;
+    }
+    for (int i = 0; i < nRegions; i++) regions[i].epochFaults = 0;
+}
 
-            // Setup pfPage
-            pfPage->pageFrame = pageFrame;
-            if (newPage) enquePage(pfPage);
+/**
+* Allocate Frames
+* * Updates the frame allocation on a fault on a non-present page of a region, before the
+* * page is placed. Caller must hold the pager lock.
+* @param region the region that faulted
+*/
+static void allocateFrames(Region *region) {
+    unsigned int now = mmContext.now;
+    region->epochFaults++;
+    if (allocMode == ALLOC_PFF && !region->throttled) {
+        if (now - region->lastFault <= (unsigned int)allocWindow) {
+            if (region->target < pFrames) region->target++;
         } else {
-            // Using a policy that doesn't exist
-            exit(-1);
+            // Faulting slowly, keep only the pages used since the last fault
+            sampleRegion(region, true);
+            region->target = region->resident + 1;
         }
     }
+    region->lastFault = now;
 
-    mm_logger(virtualPage, cause, evictedPage, writeBack, (pfPage->pageFrame * pageSize) + pageOffet);
+    if (allocMode == ALLOC_WS && ++faultsSinceSample >= allocWindow) {
+        faultsSinceSample = 0;
+        for (int i = 0; i < nRegions; i++) {
+            int used = sampleRegion(&regions[i], false);
+            if (!regions[i].throttled) regions[i].target = used > 0 ? used : 1;
+        }
+    }
+    if (allocMode >= ALLOC_PFF && ++faultsSinceCheck >= pFrames) {
+        faultsSinceCheck = 0;
+        checkThrashing();
+    }
 }
 
 /**
-* Memory Management Init
-* * Initializes the memory management system
-* @param vm Pointer to the start of a memory region
-* @param vm_size Size of the virtual memory region
-* @param n_frames Number of physical pages in the system
-* @param page_size Size of both physical and virtual pages
-* @param policy MM Policy, 1 = FIFO, 2 = Clock replacement
+* Current Node
+* * Finds the node of the calling thread. Threads not bound to a node with
+* * mm_set_thread_node get the nodes in turn at their first fault.
+* @return the node
 */
-void mm_init(void* vm, int vm_size, int n_frames, int page_size, int policy) {
-    // Assign global variables
-    mmPolicy = policy;
-    start = (char *)vm;
-    size = vm_size;
-    pageSize = page_size;
-    pFrames = n_frames;
+static int currentNode(void) {
+    if (threadNode < 0) threadNode = __atomic_fetch_add(&nextThreadNode, 1, __ATOMIC_RELAXED) % nNumaNodes;
+    return threadNode;
+}
 
-    // Set page fault handler
-    struct sigaction sigAction;
-    sigAction.sa_sigaction=pfHandler;
-    sigemptyset(&(sigAction.sa_mask));
-    sigAction.sa_flags = SA_SIGINFO;
-    if (sigaction(SIGSEGV, &sigAction, NULL) != 0) exit(-1);
+/**
+* Preferred Node
+* * Picks the node a page should be placed on
+* @param page the page to place
+* @return the node of the faulting thread on first touch, the page number's turn when interleaved
+*/
+static int preferredNode(Page *page) {
+    if (numaPlacement == NUMA_INTERLEAVE) return pageNumber(page) % nNumaNodes;
+    return currentNode();
+}
+
+/**
+* Node Frame
+* * Takes a free frame of a node, one released since or one never used. Caller must hold
+* * the pager lock.
+* @param node the node
+* @return the frame, -1 if every frame of the node is in use
+*/
+static int nodeFrame(int node) {
+    for (int i = nFreeFrames - 1; i >= 0; i--) {
+        int frame = freeFrames[i];
+        if (frameNodes[frame] != node) continue;
+        freeFrames[i] = freeFrames[--nFreeFrames];
+        return frame;
+    }
+    if (numaNodes[node].filled == numaNodes[node].nFrames) return -1;
+    activePages++;
+    return numaNodes[node].firstFrame + numaNodes[node].filled++;
+}
+
+/**
+* Free Frame
+* * Takes a free frame for a page. With memory nodes it comes from the node the placement
+* * prefers, or from the next node with one free. Caller must hold the pager lock.
+* @param page the page to place
+* @return the frame, -1 if every frame is in use
+*/
+static int freeFrame(Page *page) {
+    if (nNumaNodes == 0) {
+        if (nFreeFrames > 0) return freeFrames[--nFreeFrames];
+        // Not all physical frames are filled
+        if (activePages < pFrames) return activePages++;
+        return -1;
+    }
+    int preferred = preferredNode(page);
+    for (int i = 0; i < nNumaNodes; i++) {
+        int frame = nodeFrame((preferred + i) % nNumaNodes);
+        if (frame == -1) continue;
+        if (i > 0) numaMisplaced++;
+        return frame;
+    }
+    return -1;
+}
 
-    // Protect the memory region
-    if (mprotect(vm, vm_size, PROT_NONE) != 0) exit(-1);
+/**
+* Count Access
+* * Counts a fault's access to a frame as local or remote to the faulting thread's node.
+* * Caller must hold the log lock.
+* @param frame the frame accessed
+*/
+static void countAccess(int frame) {
+    NumaNode *node = &numaNodes[frameNodes[frame]];
+    if (frameNodes[frame] == currentNode()) {
+        node->localAccesses++;
+    } else {
+        node->remoteAccesses++;
+    }
+}
+
+/**
+* Remote Sample
+* * Feeds a fault on a present page to its streak of faults from other nodes. Caller must
+* * hold the page lock.
+* @param page the page that faulted
+* @return true once the streak reaches numaMigrateAfter, the page should then move
+*/
+static bool remoteSample(Page *page) {
+    int virtualPage = pageNumber(page);
+    if (frameNodes[page->pageFrame] == currentNode()) {
+        remoteStreaks[virtualPage] = 0;
+        return false;
+    }
+    if (++remoteStreaks[virtualPage] < numaMigrateAfter) return false;
+    remoteStreaks[virtualPage] = 0;
+    return true;
+}
+
+/**
+* Node Clock
+* * Second chance over the frames of a full node, like regionClock. Caller must hold the
+* * pager lock.
+* @param node the node
+* @return the page to evict
+*/
+static Page *nodeClock(NumaNode *node) {
+    while (true) {
+        Page *page = frameTable[node->firstFrame + node->hand].page;
+        node->hand = (node->hand + 1) % node->nFrames;
+        if (page->flags & PTE_REF) {
+            pteClear(page, PTE_REF);
+            protectPage(&mmContext, page);
+            continue;
+        }
+        return page;
+    }
+}
+
+/**
+* Migrate Page
+* * Moves a present page to a frame of another node. When the node is full, the page its
+* * clock picks is evicted to make room, as for a fault. The old frame stays free until a
+* * later fault fills it. Huge and shared pages stay where they are. Caller must hold the
+* * pager lock.
+* @param page the page to move
+* @param node the node to move it to
+*/
+static void migratePage(Page *page, int node) {
+    if (!(page->flags & PTE_PRESENT) || (page->flags & (PTE_HUGE | PTE_SHARED)) || frameNodes[page->pageFrame] == node) return;
+    int frame = nodeFrame(node);
+    if (frame == -1) {
+        releasePage(nodeClock(&numaNodes[node]));
+        frame = nodeFrame(node);
+    }
+
+    lockPage(page);
+    int oldFrame = page->pageFrame;
+    if (swapPath != NULL) {
+        // Threads accessing the page wait for its lock while the frame is copied
+        int prot = !(page->flags & PTE_MAPPED) ? PROT_NONE : (page->flags & PTE_WRITABLE) ? PROT_READ | PROT_WRITE : PROT_READ;
+        mprotect(pageStart(page), pageSize, PROT_NONE);
+        memcpy(swapFrame(frame), swapFrame(oldFrame), pageSize);
+        swapMapFrame(pageStart(page), frame, prot);
+    }
+    page->pageFrame = frame;
+    frameTable[frame].page = page;
+    frameTable[oldFrame].page = NULL;
+    freeFrames[nFreeFrames++] = oldFrame;
+    if (mmPolicyOps->move != NULL) mmPolicyOps->move(&mmContext, page, oldFrame);
+    numaMigrations++;
+    unlockPage(page);
+}
+
+/**
+* Place Page
+* * Gives a non-present page a frame, evicting the page the policy picks once every
+* * frame is full, and maps it. Caller must hold the pager lock and the page lock.
+* @param page the page to place
+* @param prot the protection to map the page with
+* @param evictedPage set to the virtual page evicted, -1 if none
+* @return true if the evicted page was dirty and needs writing back
+*/
+static bool placePage(Page *page, int prot, int *evictedPage) {
+    bool writeBack = false;
+    int pageFrame;
+    *evictedPage = -1;
+    if (nFreeFrames == 0 && activePages == pFrames) {
+        Region *donor = donorRegion(page);
+        if (donor != NULL) {
+            // The frame allocation picks the region that gives up a frame
+            Page *oldPage = regionClock(donor);
+            *evictedPage = pageNumber(oldPage);
+            writeBack = releasePage(oldPage);
+        }
+    }
+    pageFrame = freeFrame(page);
+    if (pageFrame == -1) {
+        // Evict the page the policy picks and take its frame
+        mmContext.writesThrottled = writeBudget > 0 && refillWriteTokens() < 1;
+        pageFrame = mmPolicyOps->selectVictim(&mmContext, page);
+        Page *oldPage = frameTable[pageFrame].page;
+        *evictedPage = pageNumber(oldPage);
+        if (oldPage->flags & PTE_HUGE) demote(rangeOf(oldPage));
+        writeBack = evictPage(oldPage);
+        // The policy picks from every frame, whatever node it is on
+        if (nNumaNodes > 0 && frameNodes[pageFrame] != preferredNode(page)) numaMisplaced++;
+    }
+
+    page->pageFrame = pageFrame;
+    pteSet(page, PTE_PRESENT);
+    frameTable[pageFrame].page = page;
+    pageIns++;
+    int range = rangeOf(page);
+    if (range != -1) hugeRanges[range].present++;
+    regionOf(page)->resident++;
+    if (swapPath != NULL) {
+        swapPageIn(pageStart(page), pageNumber(page), pageFrame, prot, page->flags & PTE_SWAPPED);
+        if (prot != PROT_NONE) pteSet(page, PTE_MAPPED);
+        if (prot & PROT_WRITE) pteSet(page, PTE_WRITABLE);
+    } else {
+        setProtection(page, prot);
+    }
+    mmPolicyOps->onFault(&mmContext, page);
+    return writeBack;
+}
+
+/**
+* Log Prefetch
+* * Passes a page read ahead to mm_logger, so the page it evicted and its write back are
+* * in the log. It is not a fault, so it is not counted as one.
+* @param virtualPage the page read ahead
+* @param evictedPage the page evicted for it, -1 if none
+* @param writeBack true if the evicted page needs writing back
+* @param phyAddr the physical address of the frame it got
+*/
+static void logPrefetch(int virtualPage, int evictedPage, bool writeBack, unsigned int phyAddr) {
+    spinLock(&logLock);
+    mm_logger(virtualPage, Prefetch, evictedPage, writeBack, phyAddr);
+    __atomic_clear(&logLock, __ATOMIC_RELEASE);
+}
+
+/**
+* Read Ahead
+* * Feeds a fault to the pattern detector. Once two faults in a row are the same
+* * stride apart, gives the next pages along the stride frames ahead of their first
+* * reference, mapped readable so that reading them takes no fault. A stream that
+* * next faults just past the window read all of it, which counts its pages as hits
+* * and referenced, keeps the stride and doubles the window. Pages another thread is
+* * faulting on are skipped. Caller must hold the pager lock.
+* @param page the page that faulted
+*/
+static void readAhead(Page *page) {
+    int virtualPage = pageNumber(page);
+    int stride = virtualPage - stream.lastPage;
+    if (stream.streak >= 2 && virtualPage == stream.nextPage) {
+        // The stream went through the window, its pages were used without a fault
+        stride = stream.stride;
+        for (int ahead = stream.lastPage + stride; ahead != virtualPage; ahead += stride) {
+            Page *used = &pageTable[ahead];
+            if (!(used->flags & PTE_PREFETCHED)) continue;
+            pteClear(used, PTE_PREFETCHED);
+            pteSet(used, PTE_REF);
+            __atomic_fetch_add(&prefetchHits, 1, __ATOMIC_RELAXED);
+        }
+        stream.streak++;
+        if (stream.window < prefetchMax) stream.window *= 2;
+        if (stream.window > prefetchMax) stream.window = prefetchMax;
+    } else if (stride == stream.stride) {
+        stream.streak++;
+    } else {
+        stream.stride = stride;
+        stream.streak = 1;
+    }
+    stream.lastPage = virtualPage;
+    stream.nextPage = -1;
+    if (stream.streak < 2 || stride == 0) return;
+
+    // Keep the window small next to memory so it cannot push out the page that faulted
+    int window = stream.window < pFrames / 4 ? stream.window : pFrames / 4;
+    Region *region = regionOf(page);
+    for (int i = 1; i <= window; i++) {
+        int nextPage = virtualPage + i * stride;
+        if (nextPage < region->firstPage || nextPage >= region->firstPage + region->nPages) break;
+        stream.nextPage = nextPage + stride;
+        Page *next = &pageTable[nextPage];
+        if (next->pageFrame != -1 || (next->flags & PTE_ZERO) || !tryLockPage(next)) continue;
+
+        // Mapped read only like a read fault would, a write still faults to mark it dirty
+        int evictedPage;
+        if (next->pageFrame == -1 && !(next->flags & PTE_ZERO)) {
+            pteSet(next, PTE_PREFETCHED | PTE_READONLY);
+            bool writeBack = placePage(next, PROT_READ, &evictedPage);
+            logPrefetch(nextPage, evictedPage, writeBack, next->pageFrame * pageSize);
+            prefetchIssued++;
+        }
+        unlockPage(next);
+    }
+}
+
+/**
+* Hand Over Frame
+* * Passes the frame of a page shared copy-on-write to the first page sharing it, which
+* * becomes its owner in the policy, leaving the page without a frame. The frame is the new
+* * owner's only copy of its contents, so it is dirty. Caller must hold the pager lock and
+* * the page lock.
+* @param page the owner of a shared frame
+*/
+static void handOverFrame(Page *page) {
+    int frame = page->pageFrame;
+    Page *heir = &pageTable[frameSharers[frame]];
+    lockPage(heir);
+    unlinkSharer(heir);
+    if (frameSharers[frame] != -1) pteSet(heir, PTE_SHARED);
+
+    // Policies that only keep frame order see the same frame, with the owner's age
+    if (mmPolicyOps->release != NULL) mmPolicyOps->release(&mmContext, page);
+    frameTable[frame].page = heir;
+    heir->stamp = page->stamp;
+    pteSet(heir, PTE_PRESENT | PTE_REF);
+    setWrite(heir, 1);
+    regionOf(heir)->resident++;
+    if (mmPolicyOps->release != NULL) mmPolicyOps->onFault(&mmContext, heir);
+    unlockPage(heir);
+
+    regionOf(page)->resident--;
+    page->pageFrame = -1;
+    pteClear(page, PTE_PRESENT | PTE_SHARED);
+}
+
+/**
+* Handle Shared Fault
+* * Handles a fault on a page sharing its frame copy-on-write. Sharers are always mapped
+* * read-only, so only the owner takes read faults, once a policy protected it. A write
+* * gives the page a frame of its own holding a copy of the shared one. An owner first
+* * hands the shared frame over to a sharer. Caller must hold the pager lock and the
+* * page lock.
+* @param page the page that faulted
+* @param write true if the access was a write
+* @param evictedPage set to the virtual page evicted, -1 if none
+* @param writeBack set to true if the evicted page needs writing back
+* @return the fault type
+*/
+static pfFaultType handleSharedFault(Page *page, bool write, int *evictedPage, bool *writeBack) {
+    *evictedPage = -1;
+    *writeBack = false;
+    if (page->flags & PTE_PREFETCHED) {
+        pteClear(page, PTE_PREFETCHED);
+        __atomic_fetch_add(&prefetchHits, 1, __ATOMIC_RELAXED);
+    }
+    if (!write) {
+        pteSet(page, PTE_REF);
+        setProtection(page, PROT_READ);
+        if (mmPolicyOps->onReference != NULL) mmPolicyOps->onReference(&mmContext, page, false);
+        return ReadRW;
+    }
+
+    int frame = page->pageFrame;
+    if (swapPath != NULL) memcpy(cowBuffer, swapFrame(frame), pageSize);
+    if (page->flags & PTE_PRESENT) {
+        handOverFrame(page);
+    } else {
+        unlinkSharer(page);
+        page->pageFrame = -1;
+    }
+    // The frame's pages may be evicted to place this one, so it stops mapping the frame first
+    if (swapPath != NULL) {
+        swapPageOut(pageStart(page), pageNumber(page), frame, false);
+        pteClear(page, PTE_MAPPED | PTE_WRITABLE | PTE_SWAPPED);
+    }
+
+    Region *region = regionOf(page);
+    region->faults++;
+    if (allocMode != ALLOC_GLOBAL) allocateFrames(region);
+    pteClear(page, PTE_READONLY);
+    pteSet(page, PTE_REF);
+    setWrite(page, 3);
+    if (swapPath != NULL) {
+        // Filled before it is accessible, so other threads never see it zero filled
+        *writeBack = placePage(page, PROT_NONE, evictedPage);
+        memcpy(swapFrame(page->pageFrame), cowBuffer, pageSize);
+        setProtection(page, PROT_READ | PROT_WRITE);
+    } else {
+        *writeBack = placePage(page, PROT_READ | PROT_WRITE, evictedPage);
+    }
+    cowCopies++;
+    return WriteRO;
+}
+
+/**
+* Log Fault
+* * Counts a handled fault by type and passes it to mm_logger
+* @param virtualPage the page that faulted
+* @param cause the fault type
+* @param evictedPage the page evicted for it, -1 if none
+* @param writeBack true if the evicted page needs writing back
+* @param phyAddr the physical address accessed
+*/
+static void logFault(int virtualPage, pfFaultType cause, int evictedPage, bool writeBack, unsigned int phyAddr) {
+    spinLock(&logLock);
+    faultCounts[cause]++;
+    // Reads of the zero frame, past the last frame, belong to no node
+    if (nNumaNodes > 0 && phyAddr / pageSize < (unsigned int)pFrames) countAccess(phyAddr / pageSize);
+    mm_logger(virtualPage, cause, evictedPage, writeBack, phyAddr);
+    __atomic_clear(&logLock, __ATOMIC_RELEASE);
+}
+
+/**
+* Record Latency
+* * Adds a fault's handling time to the power of two bucket holding it
+* @param cycles time stamp counter cycles the fault took
+*/
+static void recordLatency(unsigned long long cycles) {
+    int bucket = 63 - __builtin_clzll(cycles | 1);
+    if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+    __atomic_fetch_add(&latencyHistogram[bucket], 1, __ATOMIC_RELAXED);
+}
+
+/**
+* UFFD Thread
+* * Finds the fault history of a thread of the userfaultfd engine by open addressing on its
+* * id. When every slot is taken, the thread takes over the slot its id hashes to.
+* @param tid id of the faulting thread
+*/
+static FaultThread *uffdThread(int tid) {
+    int home = tid % UFFD_THREADS;
+    for (int i = 0; i < UFFD_THREADS; i++) {
+        FaultThread *thread = &uffdThreads[(home + i) % UFFD_THREADS];
+        if (thread->tid == tid) return thread;
+        if (thread->tid == 0) {
+            thread->tid = tid;
+            return thread;
+        }
+    }
+    uffdThreads[home] = (FaultThread){.tid = tid};
+    return &uffdThreads[home];
+}
+
+/**
+* Fault Retried
+* * Records a fault of a thread and tells if it retries the instruction of its last fault.
+* * An access spanning two pages faults at the first byte it touches on either, so faulting
+* * at one address, then at the start of a page less than an access above or below it, then
+* * at that address again, means the instruction made no progress and needs both pages.
+* @param thread fault history of the faulting thread
+* @param addr the faulting address
+*/
+static bool faultRetried(FaultThread *thread, char *addr) {
+    uintptr_t low = (uintptr_t)(addr < thread->lastAddr ? addr : thread->lastAddr);
+    uintptr_t high = (uintptr_t)(addr < thread->lastAddr ? thread->lastAddr : addr);
+    bool retried = addr == thread->prevAddr && high > low && high - low < MAX_ACCESS && high % pageSize == 0;
+    thread->prevAddr = thread->lastAddr;
+    thread->lastAddr = addr;
+    return retried;
+}
+
+/**
+* Track Fault
+* * Revokes access to the pages of a thread's earlier faults, so that their next references
+* * fault again and are seen by onReference. On a retried fault the page of the last fault
+* * stays accessible until the next fault. Caller must hold the pager lock.
+* @param thread fault history of the faulting thread
+* @param page the page the current fault was taken on
+* @param retried true if the fault retries the instruction of the last one
+*/
+static void trackFault(FaultThread *thread, Page *page, bool retried) {
+    if (!mmPolicyOps->trackReferences) return;
+    Page **tracked = thread->tracked;
+    for (int i = retried ? 1 : 0; i < 2; i++) {
+        if (tracked[i] != NULL && tracked[i] != page && (tracked[i]->flags & PTE_PRESENT)) {
+            pteClear(tracked[i], PTE_REF);
+            protectPage(&mmContext, tracked[i]);
+        }
+    }
+    tracked[1] = retried && tracked[0] != page ? tracked[0] : NULL;
+    tracked[0] = page;
+}
+
+/**
+* Main Functions
+*/
+
+/**
+* Handle Fault
+* * Places or grants access to the page holding a faulting address. The page lock
+* * serializes faults on one page. Faults on present pages take the pager lock only
+* * when the policy needs to see them or the page is promoted or migrated, so they go
+* * on beside faults that place pages.
+* @param addr the faulting address
+* @param write true if the access was a write
+* @param thread fault history of the faulting thread
+*/
+static void handleFault(char *addr, bool write, FaultThread *thread) {
+    // Check if address is in range of allocated memory
+    Region *region = NULL;
+    for (int i = 0; i < nRegions && region == NULL; i++) {
+        if (addr >= regions[i].start && addr < regions[i].start + regions[i].size) region = &regions[i];
+    }
+    if (region == NULL) exit(SIGSEGV);
+    bool retried = faultRetried(thread, addr);
+
+    int virtualPage = region->firstPage + (addr - region->start) / pageSize;
+    int pageOffet = (addr - region->start) % pageSize;
+
+    Page *pfPage = &pageTable[virtualPage];
+    lockPage(pfPage);
+    bool huge = false;
+    bool shared = false;
+    if (pfPage->flags & (PTE_HUGE | PTE_SHARED)) {
+        // Huge pages change as a whole, and shared frames with all their pages, under the
+        // pager lock, which is taken before page locks
+        unlockPage(pfPage);
+        lockPager();
+        lockPage(pfPage);
+        huge = pfPage->flags & PTE_HUGE;
+        shared = pfPage->flags & PTE_SHARED;
+        if (!huge && !shared) unlockPager();
+    }
+    if (pfPage->flags & (write ? PTE_WRITABLE : PTE_MAPPED)) {
+        // Another thread faulted on the page first and already granted this access
+        __atomic_fetch_add(&spuriousFaults, 1, __ATOMIC_RELAXED);
+        unlockPage(pfPage);
+        if (huge || shared) unlockPager();
+        return;
+    }
+    __atomic_fetch_add(&mmContext.now, 1, __ATOMIC_RELAXED);
+    if (allocMode != ALLOC_GLOBAL) pteSet(pfPage, PTE_USED);
+    if (write) pteSet(pfPage, PTE_DATA);
+
+    if (shared) {
+        bool writeBack;
+        int evictedPage;
+        pfFaultType cause = handleSharedFault(pfPage, write, &evictedPage, &writeBack);
+        trackFault(thread, pfPage, retried);
+        logFault(virtualPage, cause, evictedPage, writeBack, (pfPage->pageFrame * pageSize) + pageOffet);
+        unlockPage(pfPage);
+        sampleReferences();
+        long waitUs = writeBack ? writeWait() : 0;
+        unlockPager();
+        if (waitUs > 0) sleepUs(waitUs);
+        return;
+    }
+
+    if (huge) {
+        pfFaultType cause = handleHugeFault(pfPage, write);
+        logFault(virtualPage, cause, -1, false, (pfPage->pageFrame * pageSize) + pageOffet);
+        if (mmPolicyOps->onReference != NULL) mmPolicyOps->onReference(&mmContext, pfPage, write);
+        trackFault(thread, pfPage, retried);
+        unlockPage(pfPage);
+        sampleReferences();
+        unlockPager();
+        return;
+    }
+
+    // Detemine cause of page fault
+    bool writeBack = false;
+    int evictedPage = -1;
+    pfFaultType cause;
+    int prot;
+    if (pfPage->pageFrame == -1) {
+        // Page not present, it is mapped once it has a frame
+        if (!write && zeroPageEnabled && !(pfPage->flags & (PTE_DATA | PTE_SWAPPED | PTE_ZERO))) {
+            // Never written, so it reads as zeros without a frame of its own
+            pteSet(pfPage, PTE_READONLY | PTE_ZERO);
+            if (swapPath != NULL) {
+                swapMapZero(pageStart(pfPage));
+                pteSet(pfPage, PTE_MAPPED);
+            } else {
+                setProtection(pfPage, PROT_READ);
+            }
+            __atomic_fetch_add(&zeroMaps, 1, __ATOMIC_RELAXED);
+            logFault(virtualPage, ReadNPP, -1, false, (pFrames * pageSize) + pageOffet);
+            unlockPage(pfPage);
+            return;
+        } else if (pfPage->flags & PTE_ZERO) {
+            // First write to a page mapped to the zero frame, it gets a zero filled frame
+            cause = WriteRO;
+            pteClear(pfPage, PTE_READONLY | PTE_ZERO);
+            pteSet(pfPage, PTE_REF);
+            setWrite(pfPage, 3);
+            prot = PROT_READ | PROT_WRITE;
+        } else if (!write) {
+            cause = ReadNPP;
+            pteSet(pfPage, PTE_READONLY | PTE_REF);
+            prot = PROT_READ;
+        } else {
+            cause = WriteNPP;
+            pteSet(pfPage, PTE_REF);
+            setWrite(pfPage, 3);
+            prot = PROT_READ | PROT_WRITE;
+        }
+    } else {
+        // Page present, no page placement necessary
+        if (pfPage->flags & PTE_PREFETCHED) {
+            // First write to a page read ahead, which was mapped read only
+            pteClear(pfPage, PTE_PREFETCHED);
+            __atomic_fetch_add(&prefetchHits, 1, __ATOMIC_RELAXED);
+        }
+        if ((pfPage->flags & PTE_READONLY) && write) {
+            cause = WriteRO;
+            pteClear(pfPage, PTE_READONLY);
+            pteSet(pfPage, PTE_REF);
+            setWrite(pfPage, 3);
+            setProtection(pfPage, PROT_READ | PROT_WRITE);
+        } else {
+            // Only triggered once a policy has protected the page to see its references
+            if (!write) {
+                cause = ReadRW;
+                pteSet(pfPage, PTE_REF);
+                setProtection(pfPage, PROT_READ);
+            } else {
+                cause = WriteRW;
+                pteSet(pfPage, PTE_REF);
+                setWrite(pfPage, 3);
+                setProtection(pfPage, PROT_READ | PROT_WRITE);
+            }
+        }
+        logFault(virtualPage, cause, evictedPage, writeBack, (pfPage->pageFrame * pageSize) + pageOffet);
+        bool migrate = numaMigrateAfter > 0 && remoteSample(pfPage);
+        unlockPage(pfPage);
+
+        // The page may have been evicted since, then the policy no longer tracks it
+        int range = rangeOf(pfPage);
+        bool promote = range != -1 && hugeRanges[range].present == hugePages && !hugeRanges[range].promoted;
+        if (mmPolicyOps->onReference != NULL || promote || migrate) {
+            lockPager();
+                if (mmPolicyOps->onReference != NULL && (pfPage->flags & PTE_PRESENT)) {
+                mmPolicyOps->onReference(&mmContext, pfPage, write);
+                trackFault(thread, pfPage, retried);
+            }
+            if (migrate) migratePage(pfPage, currentNode());
+            if (promote) tryPromote(range, NULL);
+            sampleReferences();
+            unlockPager();
+        }
+        return;
+    }
+
+    if (__atomic_load_n(&region->throttled, __ATOMIC_RELAXED)) {
+        // Hold the thrashing region back so the others can keep their pages
+        sleepUs(THROTTLE_US);
+    }
+    lockPager();
+    region->faults++;
+    if (allocMode != ALLOC_GLOBAL) allocateFrames(region);
+    writeBack = placePage(pfPage, prot, &evictedPage);
+    trackFault(thread, pfPage, retried);
+    logFault(virtualPage, cause, evictedPage, writeBack, (pfPage->pageFrame * pageSize) + pageOffet);
+    if (rangeOf(pfPage) != -1) tryPromote(rangeOf(pfPage), pfPage);
+    unlockPage(pfPage);
+    if (prefetchMax > 0) readAhead(pfPage);
+    sampleReferences();
+    long waitUs = writeBack ? writeWait() : 0;
+    unlockPager();
+    // Past the write back budget, the fault waits for the write it caused
+    if (waitUs > 0) sleepUs(waitUs);
+}
+
+/**
+* Page Fault Handler
+* * Handles a page fault which generates a SIGSEGV signal, timing it with the time stamp counter
+* @param sig 
+* @param sigInfo
+* @param context
+*/
+static void pfHandler(int sig, siginfo_t *sigInfo, void *context) {
+    unsigned long long begin = __rdtsc();
+    greg_t *regs = ((ucontext_t *)context)->uc_mcontext.gregs;
+    bool write = regs[REG_ERR] & (PF_WRITE);
+    handleFault((char *)sigInfo->si_addr, write, &signalThread);
+    recordLatency(__rdtsc() - begin);
+}
+
+/**
+* Userfaultfd Fault
+* * Handles a fault read by the userfaultfd engine's fault thread, timing it like pfHandler
+* @param addr the faulting address
+* @param write true if the access was a write
+* @param tid id of the faulting thread
+*/
+static void uffdFault(char *addr, bool write, int tid) {
+    unsigned long long begin = __rdtsc();
+    handleFault(addr, write, uffdThread(tid));
+    recordLatency(__rdtsc() - begin);
+}
+
+/**
+* Set Swap File
+* * Backs the region with a swap file and a frame pool, must be called before mm_init
+* @param path path of the swap file, created or truncated by mm_init
+*/
+void mm_set_swap_file(const char *path) {
+    swapPath = path;
+}
+
+/**
+* Set Cleaner
+* * Starts a background cleaner with mm_init, must be called before mm_init
+* @param low percentage of dirty frames the cleaner stops at
+* @param high percentage of dirty frames above which the cleaner starts
+* @param interval_ms milliseconds between checks
+*/
+void mm_set_cleaner(int low, int high, int interval_ms) {
+    if (low < 0 || high > 100 || low >= high || interval_ms < 1) {
+        printf("Invalid cleaner watermarks\n");
+        exit(-1);
+    }
+    cleanerEnabled = true;
+    cleanerLow = low;
+    cleanerHigh = high;
+    cleanerInterval = interval_ms;
+}
+
+/**
+* Set I/O Cost
+* * Sets the modeled time of reading a page in and of writing a dirty page back, which the
+* * cost-aware policy weighs victims by, must be called before mm_init
+* @param read_us microseconds to read a page in
+* @param write_us microseconds to write a dirty page back
+*/
+void mm_set_io_cost(int read_us, int write_us) {
+    if (read_us < 1 || write_us < 0) {
+        printf("Invalid I/O cost\n");
+        exit(-1);
+    }
+    readCostUs = read_us;
+    writeCostUs = write_us;
+}
+
+/**
+* Set Write Budget
+* * Caps the write backs per second, must be called before mm_init. A fault that writes a
+* * page back past the budget waits until the budget allows it, the cleaner only cleans
+* * while the budget has room and the cost-aware policy evicts clean pages first.
+* @param per_second write backs allowed per second, 0 for no cap
+*/
+void mm_set_write_budget(int per_second) {
+    if (per_second < 0) {
+        printf("Invalid write back budget\n");
+        exit(-1);
+    }
+    writeBudget = per_second;
+}
+
+/**
+* Set Userfaultfd
+* * Takes faults through a userfaultfd and a fault thread instead of SIGSEGV, must be
+* * called before mm_init
+*/
+void mm_set_userfaultfd() {
+    uffdEnabled = true;
+}
+
+/**
+* Set Sweep Interval
+* * Samples reference bits every few faults instead of on every one, must be called
+* * before mm_init
+* @param faults number of faults that reach the policy between samples
+*/
+void mm_set_sweep_interval(int faults) {
+    if (faults < 1) {
+        printf("Invalid sweep interval\n");
+        exit(-1);
+    }
+    sweepInterval = faults;
+}
+
+/**
+* Set Prefetch
+* * Reads ahead of sequential and strided faults, must be called before mm_init
+* @param max_window most pages read ahead of a fault
+*/
+void mm_set_prefetch(int max_window) {
+    if (max_window < 1) {
+        printf("Invalid prefetch window\n");
+        exit(-1);
+    }
+    prefetchMax = max_window;
+    stream.window = max_window < 2 ? max_window : 2;
+}
+
+/**
+* Set Huge Pages
+* * Promotes aligned ranges of base pages to huge pages once every page of one is hot,
+* * must be called before mm_init
+* @param huge_size size of a huge page in bytes, a multiple of the page size
+*/
+void mm_set_huge_pages(int huge_size) {
+    if (huge_size < 1) {
+        printf("Invalid huge page size\n");
+        exit(-1);
+    }
+    hugeSize = huge_size;
+}
+
+/**
+* Set Compressed Tier
+* * Compresses dirty pages evicted into a pool in memory before the swap file, must be
+* * called before mm_init
+* @param max_kb most KiB of memory the pool takes
+*/
+void mm_set_compressed_tier(int max_kb) {
+    if (max_kb < 1) {
+        printf("Invalid compressed tier size\n");
+        exit(-1);
+    }
+    tierBytes = (long)max_kb * 1024;
+}
+
+/**
+* Set Zero Page
+* * Maps pages read before they are ever written to the shared zero frame, must be called
+* * before mm_init
+*/
+void mm_set_zero_page() {
+    zeroPageEnabled = true;
+}
+
+/**
+* Close Memory
+* * Closes /proc/self/mem at exit, once no clone can copy through it
+*/
+static void closeMemory(void) {
+    close(memFd);
+    memFd = -1;
+}
+
+/**
+* Clone Region
+* * Makes a region a copy of another of the same size. Pages of the source holding a frame
+* * share it with the target's until either is written, the source's other contents are
+* * copied. The source's present pages are write-protected for it.
+* @param source the region copied
+* @param target a region of the same size no thread has accessed yet
+*/
+void mm_clone_region(int source, int target) {
+    if (source < 0 || source >= nRegions || target < 0 || target >= nRegions || source == target ||
+        regions[source].nPages != regions[target].nPages || hugeSize != -1 || frameSharers == NULL) {
+        printf("Invalid clone\n");
+        exit(-1);
+    }
+    Region *from = &regions[source];
+    Region *to = &regions[target];
+    for (int i = 0; i < to->nPages; i++) {
+        if (pageTable[to->firstPage + i].pageFrame != -1 || (pageTable[to->firstPage + i].flags & (PTE_MAPPED | PTE_DATA | PTE_SWAPPED))) {
+            printf("Invalid clone\n");
+            exit(-1);
+        }
+    }
+    if (swapPath == NULL && memFd == -1) {
+        // Reads and writes through it ignore the protection of the pages
+        memFd = open("/proc/self/mem", O_RDWR | O_CLOEXEC);
+        if (memFd == -1) {
+            perror("clone");
+            exit(-1);
+        }
+        atexit(closeMemory);
+    }
+
+    lockPager();
+    for (int i = 0; i < from->nPages; i++) {
+        Page *page = &pageTable[from->firstPage + i];
+        Page *copy = &pageTable[to->firstPage + i];
+        if (page->flags & PTE_PRESENT) {
+            // Write-protect the owner first, so no write lands in the frame once it is shared
+            lockPage(page);
+            if (page->flags & PTE_WRITABLE) setProtection(page, PROT_READ);
+            pteSet(page, PTE_READONLY | PTE_SHARED);
+            unlockPage(page);
+
+            copy->pageFrame = page->pageFrame;
+            nextSharer[pageNumber(copy)] = frameSharers[page->pageFrame];
+            frameSharers[page->pageFrame] = pageNumber(copy);
+            pteSet(copy, PTE_READONLY | PTE_SHARED | PTE_DATA);
+            if (swapPath != NULL) {
+                swapMapFrame(pageStart(copy), page->pageFrame, PROT_READ);
+                pteSet(copy, PTE_MAPPED);
+            }
+            sharedPages++;
+        } else if (swapPath != NULL && (page->flags & PTE_SWAPPED)) {
+            swapCopyPage(pageNumber(page), pageNumber(copy), cowBuffer);
+            pteSet(copy, PTE_SWAPPED | PTE_DATA);
+        } else if (swapPath == NULL && (page->flags & PTE_DATA)) {
+            pteSet(copy, PTE_DATA);
+        }
+
+        // Without a swap file every page's contents stay in place, shared or not
+        if (swapPath == NULL && (copy->flags & PTE_DATA)) {
+            if (pread(memFd, cowBuffer, pageSize, (off_t)(unsigned long)pageStart(page)) != pageSize ||
+                pwrite(memFd, cowBuffer, pageSize, (off_t)(unsigned long)pageStart(copy)) != pageSize) {
+                perror("clone");
+                exit(-1);
+            }
+            if (copy->flags & PTE_SHARED) setProtection(copy, PROT_READ);
+        }
+    }
+    unlockPager();
+}
+
+/**
+* Add Region
+* * Registers another region, managed as its own process, must be called before mm_init
+* @param vm Pointer to the start of the region, aligned to the page size
+* @param vm_size Size of the region
+* @return the region number, mm_init's region is region 0
+*/
+int mm_add_region(void *vm, int vm_size) {
+    if (nRegions == MAX_REGIONS || vm_size < 1) {
+        printf("Invalid region\n");
+        exit(-1);
+    }
+    regions[nRegions].start = vm;
+    regions[nRegions].size = vm_size;
+    return nRegions++;
+}
+
+/**
+* Set Frame Allocation
+* * Splits the frames between the regions, must be called before mm_init
+* @param mode 0 = global replacement, 1 = equal shares, 2 = page fault frequency, 3 = working set
+* @param window PFF's critical interval between faults, or the working set window, in faults
+*/
+void mm_set_frame_allocation(int mode, int window) {
+    if (mode < ALLOC_GLOBAL || mode > ALLOC_WS || (mode >= ALLOC_PFF && window < 1)) {
+        printf("Invalid frame allocation\n");
+        exit(-1);
+    }
+    allocMode = mode;
+    allocWindow = window;
+}
+
+/**
+* Add NUMA Node
+* * Adds a memory node, must be called before mm_init
+* @param n_frames Number of frames of the node
+* @param local_ns Modeled cost of an access from a thread of the node
+* @param remote_ns Modeled cost of an access from a thread of another node
+* @return the node number
+*/
+int mm_add_numa_node(int n_frames, int local_ns, int remote_ns) {
+    if (nNumaNodes == MAX_NODES || n_frames < 1 || local_ns < 0 || remote_ns < 0) {
+        printf("Invalid NUMA node\n");
+        exit(-1);
+    }
+    numaNodes[nNumaNodes].nFrames = n_frames;
+    numaNodes[nNumaNodes].localNs = local_ns;
+    numaNodes[nNumaNodes].remoteNs = remote_ns;
+    return nNumaNodes++;
+}
+
+/**
+* Set NUMA Policy
+* * Picks how pages are placed on the nodes and when they migrate, must be called before mm_init
+* @param placement 0 = first touch, 1 = interleave
+* @param migrate_after Faults in a row from other nodes that move a page, 0 to never move pages
+*/
+void mm_set_numa_policy(int placement, int migrate_after) {
+    if (placement < NUMA_FIRST_TOUCH || placement > NUMA_INTERLEAVE || migrate_after < 0 || migrate_after > 255) {
+        printf("Invalid NUMA policy\n");
+        exit(-1);
+    }
+    numaPlacement = placement;
+    numaMigrateAfter = migrate_after;
+}
+
+/**
+* Set Thread Node
+* * Binds the calling thread to a node, its accesses are local to that node's frames
+* @param node the node
+*/
+void mm_set_thread_node(int node) {
+    if (node < 0 || node >= nNumaNodes) {
+        printf("Invalid NUMA node\n");
+        exit(-1);
+    }
+    threadNode = node;
+}
+
+unsigned long mm_report_nlocal_accesses() {
+    unsigned long total = 0;
+    for (int i = 0; i < nNumaNodes; i++) total += numaNodes[i].localAccesses;
+    return total;
+}
+
+unsigned long mm_report_nremote_accesses() {
+    unsigned long total = 0;
+    for (int i = 0; i < nNumaNodes; i++) total += numaNodes[i].remoteAccesses;
+    return total;
+}
+
+unsigned long mm_report_nmigrations() {
+    return numaMigrations;
+}
+
+unsigned long mm_report_region_faults(int region) {
+    if (region < 0 || region >= nRegions) return 0;
+    return regions[region].faults;
+}
+
+int mm_report_region_frames(int region) {
+    if (region < 0 || region >= nRegions) return 0;
+    return regions[region].resident;
+}
+
+unsigned long mm_report_region_throttles(int region) {
+    if (region < 0 || region >= nRegions) return 0;
+    return regions[region].throttles;
+}
+
+unsigned long mm_report_nhuge_promotions() {
+    return promotions;
+}
+
+unsigned long mm_report_nhuge_demotions() {
+    return demotions;
+}
+
+unsigned long mm_report_ntier_stores() {
+    return tierStores;
+}
+
+unsigned long mm_report_ntier_hits() {
+    return tierHits;
+}
+
+unsigned long mm_report_nzero_maps() {
+    return zeroMaps;
+}
+
+unsigned long mm_report_ncow_copies() {
+    return cowCopies;
+}
+
+unsigned long mm_report_nprefetches() {
+    return prefetchIssued;
+}
+
+unsigned long mm_report_nprefetch_hits() {
+    return prefetchHits;
+}
+
+unsigned long mm_report_nprefetch_waste() {
+    return prefetchWasted;
+}
+
+unsigned long mm_report_npage_faults() {
+    unsigned long faults = 0;
+    for (int i = 0; i < 5; i++) faults += faultCounts[i];
+    return faults;
+}
+
+unsigned long mm_report_nwrite_backs() {
+    return writeBacks + cleanedPages;
+}
+
+unsigned long mm_report_nfaults(int fault_type) {
+    if (fault_type < ReadNPP || fault_type > WriteRW) return 0;
+    return faultCounts[fault_type];
+}
+
+unsigned long mm_report_nevictions() {
+    return evictions;
+}
+
+unsigned long mm_report_npage_ins() {
+    return pageIns;
+}
+
+unsigned long mm_report_nthrottled_writes() {
+    return throttledWrites;
+}
+
+void mm_report_latency(unsigned long histogram[LATENCY_BUCKETS]) {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) histogram[i] = __atomic_load_n(&latencyHistogram[i], __ATOMIC_RELAXED);
+}
+
+/**
+* Print Report
+* * Prints the fault counters, the eviction and write back rates and the latency histogram
+*/
+void mm_print_report() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = (now.tv_sec - initTime.tv_sec) + (now.tv_nsec - initTime.tv_nsec) / 1e9;
+    unsigned long faults = mm_report_npage_faults();
+    unsigned long written = mm_report_nwrite_backs();
+
+    printf("faults: %lu\n", faults);
+    printf("  ReadNPP: %lu  WriteNPP: %lu  WriteRO: %lu  ReadRW: %lu  WriteRW: %lu\n",
+           faultCounts[ReadNPP], faultCounts[WriteNPP], faultCounts[WriteRO], faultCounts[ReadRW], faultCounts[WriteRW]);
+    printf("evictions: %lu (%.3f per fault, %.0f per second)\n",
+           evictions, faults ? (double)evictions / faults : 0.0, seconds > 0 ? evictions / seconds : 0.0);
+    printf("write backs: %lu (%lu evicted, %lu cleaned, %.3f per fault, %.0f per second)\n",
+           written, writeBacks, cleanedPages, faults ? (double)written / faults : 0.0, seconds > 0 ? written / seconds : 0.0);
+    printf("modeled I/O: %lu page ins (%d us), %lu write backs (%d us), %.1f ms\n", pageIns, readCostUs, written,
+           writeCostUs, ((double)pageIns * readCostUs + (double)written * writeCostUs) / 1000);
+    if (writeBudget > 0) {
+        printf("write back budget: %d per second, %lu faults waited %.1f ms for it\n", writeBudget, throttledWrites, throttledUs / 1000.0);
+    }
+    if (prefetchMax > 0) {
+        printf("prefetched: %lu  hits: %lu  wasted: %lu\n", prefetchIssued, prefetchHits, prefetchWasted);
+    }
+    if (tierBytes > 0) {
+        // The ratio leaves out same-filled pages, which take no pool memory at all
+        unsigned long pages, bytes, slabBytes;
+        tierUsage(&pages, &bytes, &slabBytes);
+        printf("compressed tier: %lu stored (%lu same filled), %lu rejected, %lu written back to swap\n",
+               tierStores, tierSameFilled, tierRejected, tierWriteBacks);
+        printf("  holds %lu pages in %lu KiB of %lu KiB of slabs, ratio %.2f\n", pages, bytes / 1024, slabBytes / 1024,
+               bytes ? (double)pages * pageSize / bytes : 0.0);
+        printf("  hits: %lu of %lu pages swapped in (%.1f%%)\n", tierHits, swapPageIns,
+               swapPageIns ? 100.0 * tierHits / swapPageIns : 0.0);
+        printf("  cycles per compression: %.0f  per decompression: %.0f\n",
+               tierCompressions ? (double)tierCompressCycles / tierCompressions : 0.0,
+               tierDecompressions ? (double)tierDecompressCycles / tierDecompressions : 0.0);
+    }
+    if (zeroPageEnabled || sharedPages > 0) {
+        printf("zero page: %lu reads mapped  shared copy-on-write: %lu  copied on write: %lu  unshared by eviction: %lu\n",
+               zeroMaps, sharedPages, cowCopies, sharedEvictions);
+    }
+    if (hugeSize != -1) {
+        // Every huge page takes one TLB entry where its base pages would take one each
+        int basePages = activePages - nFreeFrames - hugeMapped * hugePages;
+        printf("huge pages: %d mapped (%d pages each), %lu promoted, %lu demoted, %lu collapsed\n",
+               hugeMapped, hugePages, promotions, demotions, collapses);
+        printf("frames: %d as base pages, %d as huge pages, TLB reach %lu KiB in %d entries\n",
+               basePages, hugeMapped * hugePages, ((unsigned long)basePages * pageSize + (unsigned long)hugeMapped * hugeSize) / 1024,
+               basePages + hugeMapped);
+    }
+    if (nRegions > 1 || allocMode != ALLOC_GLOBAL) {
+        for (int i = 0; i < nRegions; i++) {
+            Region *region = &regions[i];
+            printf("region %d: %d pages, %d frames (target %d), %lu faults, throttled %lu times%s\n", i, region->nPages,
+                   region->resident, region->target, region->faults, region->throttles, region->throttled ? ", now throttled" : "");
+        }
+    }
+    if (nNumaNodes > 0) {
+        unsigned long local = mm_report_nlocal_accesses();
+        unsigned long remote = mm_report_nremote_accesses();
+        double nanoseconds = 0;
+        printf("numa: %d nodes, %s placement, %lu pages placed off their node, %lu migrated\n", nNumaNodes,
+               numaPlacement == NUMA_INTERLEAVE ? "interleave" : "first touch", numaMisplaced, numaMigrations);
+        for (int i = 0; i < nNumaNodes; i++) {
+            NumaNode *node = &numaNodes[i];
+            int used = 0;
+            for (int frame = node->firstFrame; frame < node->firstFrame + node->nFrames; frame++) used += frameTable[frame].page != NULL;
+            printf("  node %d: frames %d - %d, %d in use, %lu local and %lu remote accesses (%d/%d ns)\n", i, node->firstFrame,
+                   node->firstFrame + node->nFrames - 1, used, node->localAccesses, node->remoteAccesses, node->localNs, node->remoteNs);
+            nanoseconds += (double)node->localAccesses * node->localNs + (double)node->remoteAccesses * node->remoteNs;
+        }
+        printf("remote accesses: %lu of %lu (%.1f%%), modeled memory time %.1f us (%.1f ns per access)\n", remote, local + remote,
+               local + remote ? 100.0 * remote / (local + remote) : 0.0, nanoseconds / 1000, local + remote ? nanoseconds / (local + remote) : 0.0);
+    }
+    printf("protection changes: %lu (%.3f per eviction)\n", protectCalls, evictions ? (double)protectCalls / evictions : 0.0);
+    if (spuriousFaults > 0) printf("faults already handled by another thread: %lu\n", spuriousFaults);
+    printf("fault latency (cycles):\n");
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        unsigned long count = __atomic_load_n(&latencyHistogram[i], __ATOMIC_RELAXED);
+        if (count == 0) continue;
+        if (i == LATENCY_BUCKETS - 1) {
+            printf("  >= %llu: %lu\n", 1ULL << i, count);
+        } else {
+            printf("  %llu - %llu: %lu\n", 1ULL << i, (1ULL << (i + 1)) - 1, count);
+        }
+    }
+}
+
+/**
+* Memory Management Init
+* * Initializes the memory management system
+* @param vm Pointer to the start of a memory region
+* @param vm_size Size of the virtual memory region
+* @param n_frames Number of physical pages in the system
+* @param page_size Size of both physical and virtual pages
+* @param policy MM Policy, 1 = FIFO, 2 = Clock replacement, 3 = Aging LRU, 4 = WSClock, 5 = ARC, 6 = 2Q,
+* *               7 = Cost-aware
+*/
+void mm_init(void* vm, int vm_size, int n_frames, int page_size, int policy) {
+    // Assign global variables
+    mmPolicy = policy;
+    start = (char *)vm;
+    size = vm_size;
+    pageSize = page_size;
+    pFrames = n_frames;
+    clock_gettime(CLOCK_MONOTONIC, &initTime);
+
+    // Build the page table before any fault can reach the handler
+    regions[0].start = start;
+    regions[0].size = vm_size;
+    nPages = 0;
+    for (int i = 0; i < nRegions; i++) {
+        if (i > 0 && (unsigned long)regions[i].start % page_size != 0) {
+            printf("Invalid region\n");
+            exit(-1);
+        }
+        regions[i].firstPage = nPages;
+        regions[i].nPages = (regions[i].size + page_size - 1) / page_size;
+        regions[i].target = allocMode == ALLOC_GLOBAL ? n_frames : n_frames / nRegions + (i < n_frames % nRegions);
+        if (regions[i].target < 1) regions[i].target = 1;
+        nPages += regions[i].nPages;
+    }
+    pageTable = calloc(nPages, sizeof(Page));
+    if (pageTable == NULL) exit(-1);
+    for (int i = 0; i < nPages; i++) pageTable[i].pageFrame = -1;
+    frameTable = calloc(n_frames, sizeof(Frame));
+    if (frameTable == NULL) exit(-1);
+    pendingPages = calloc(n_frames, sizeof(int));
+    if (pendingPages == NULL) exit(-1);
+    freeFrames = calloc(n_frames, sizeof(int));
+    if (freeFrames == NULL) exit(-1);
+    frameSharers = malloc(n_frames * sizeof(int));
+    nextSharer = malloc(nPages * sizeof(int));
+    cowBuffer = malloc(page_size);
+    if (frameSharers == NULL || nextSharer == NULL || cowBuffer == NULL) exit(-1);
+    for (int i = 0; i < n_frames; i++) frameSharers[i] = -1;
+
+    // Frames are numbered node by node, in the order the nodes were added
+    if (nNumaNodes > 0) {
+        frameNodes = malloc(n_frames);
+        remoteStreaks = calloc(nPages, 1);
+        if (frameNodes == NULL || remoteStreaks == NULL) exit(-1);
+        int frames = 0;
+        for (int i = 0; i < nNumaNodes; i++) {
+            numaNodes[i].firstFrame = frames;
+            for (int j = 0; j < numaNodes[i].nFrames && frames + j < n_frames; j++) frameNodes[frames + j] = i;
+            frames += numaNodes[i].nFrames;
+        }
+        if (frames != n_frames) {
+            printf("The NUMA nodes must add up to the frames\n");
+            exit(-1);
+        }
+    }
+
+    // Huge pages cover the ranges aligned to their size in the address space, as the kernel's do
+    if (hugeSize != -1) {
+        if (hugeSize % page_size != 0 || hugeSize / page_size < 2) {
+            printf("Invalid huge page size\n");
+            exit(-1);
+        }
+        hugePages = hugeSize / page_size;
+        unsigned long misalign = (unsigned long)start % hugeSize;
+        hugeFirst = misalign == 0 ? 0 : (hugeSize - misalign) / page_size;
+        nHugeRanges = regions[0].nPages > hugeFirst ? (regions[0].nPages - hugeFirst) / hugePages : 0;
+        hugeRanges = calloc(nHugeRanges + 1, sizeof(HugeRange));
+        if (hugeRanges == NULL) exit(-1);
+        // Only private anonymous memory can be collapsed into transparent huge pages
+        hugeCollapse = !uffdEnabled && swapPath == NULL;
+        if (hugeCollapse && nHugeRanges > 0) madvise(start + (size_t)hugeFirst * page_size, (size_t)nHugeRanges * hugeSize, MADV_HUGEPAGE);
+    }
+
+    // Set up the replacement policy
+    mmPolicyOps = mm_get_policy(mmPolicy);
+    if (mmPolicyOps == NULL) exit(-1);
+    mmContext.pageTable = pageTable;
+    mmContext.nPages = nPages;
+    mmContext.frameTable = frameTable;
+    mmContext.nFrames = n_frames;
+    mmContext.readCost = readCostUs;
+    mmContext.writeCost = writeCostUs;
+    mmContext.protect = protectPage;
+    mmPolicyOps->init(&mmContext);
+    tokenTime = initTime;
+    writeTokens = writeBudget / 10 > 1 ? writeBudget / 10 : 1;
+
+    // Set up the backing store before any page is mapped
+    if (uffdEnabled && swapPath != NULL) {
+        printf("The userfaultfd engine does not support a swap file\n");
+        exit(-1);
+    }
+    if (uffdEnabled && nNumaNodes > 0) {
+        printf("The userfaultfd engine does not support NUMA nodes\n");
+        exit(-1);
+    }
+    if (uffdEnabled && nRegions > 1) {
+        printf("The userfaultfd engine supports a single region\n");
+        exit(-1);
+    }
+    if (tierBytes > 0 && swapPath == NULL) {
+        printf("The compressed tier needs a swap file\n");
+        exit(-1);
+    }
+    if (swapPath != NULL && swapInit(swapPath, page_size, n_frames) != 0) {
+        perror("swap");
+        exit(-1);
+    }
+    if (tierBytes > 0 && tierInit(nPages, page_size, tierBytes) != 0) {
+        perror("compressed tier");
+        exit(-1);
+    }
+
+    // Start the cleaner, it must not take the pager's faults
+    if (cleanerEnabled) {
+        sigset_t blocked, previous;
+        sigfillset(&blocked);
+        if (sem_init(&cleanerWake, 0, 0) != 0) exit(-1);
+        pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+        if (pthread_create(&cleanerThread, NULL, cleaner, NULL) != 0) exit(-1);
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+        pthread_detach(cleanerThread);
+    }
+
+    // Hand every fault to the fault thread, the region keeps its protection
+    if (uffdEnabled) {
+        if (uffdInit(start, vm_size, page_size, uffdFault) != 0) {
+            perror("userfaultfd");
+            exit(-1);
+        }
+        return;
+    }
+
+    // Set page fault handler
+    struct sigaction sigAction;
+    sigAction.sa_sigaction=pfHandler;
+    sigemptyset(&(sigAction.sa_mask));
+    sigAction.sa_flags = SA_SIGINFO;
+    if (sigaction(SIGSEGV, &sigAction, NULL) != 0) exit(-1);
+
+    // Protect the memory regions
+    for (int i = 0; i < nRegions; i++) {
+        if (mprotect(regions[i].start, regions[i].size, PROT_NONE) != 0) exit(-1);
+    }
 }
\ No newline at end of file
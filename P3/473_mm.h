@@ -5,7 +5,6 @@
 #ifndef _473_MM_H
 #define _473_MM_H
 
-static int statCounter = 0;
 struct MM_stats
 {
   int virt_page;
@@ -14,7 +13,7 @@ struct MM_stats
   int write_back;
   unsigned int phy_addr;
 };
-struct MM_stats *stats;
+extern struct MM_stats *stats;
 
 /* To be called from within the signal handler
  * virt_page:   Page number of the virtual page being referenced     
@@ -24,6 +23,7 @@ struct MM_stats *stats;
  *          2 - Write access to a currently Read-only page
  *          3 - Track a "read" reference to the page that has Read and/or Write permissions on.
  *          4 - Track a "write" reference to the page that has Read-Write permissions on.
+ *          5 - Not a fault, the page was read ahead ('mm_set_prefetch()').
  * evicted_page:Virtual page number that is evicted. (-1 in case of no eviction)
  * write_back:  = 1 indicates evicted page needs writing back to disk, = 0 otherwise
  * phy_addr:    Represents the physical address (frame_number concatenated with the offset)
@@ -36,17 +36,184 @@ extern void mm_logger(int virt_page, int fault_type, int evicted_page, int write
  * 'vm_size' denotes the size of the virtual address space, 
  * 'n_frames' denotes the number of physical pages available in the system, 
  * 'page_size' denotes the size of both virtual and physical pages, 
- * 'policy' can take values 1 or 2 -- 1 indicates fifo replacement policy and 2 indicates clock replacement policy. 
+ * 'policy' can take values 1 to 7 -- 1 indicates fifo replacement policy and 2 indicates clock replacement policy, 3 to 7 are aging LRU, WSClock, ARC, 2Q and cost-aware LRU. 
  */
 extern void mm_init(void *vm, int vm_size, int n_frames, int page_size, int policy); 
+
+/* 'mm_set_swap_file()' must be called before 'mm_init()'. Pages then live in a pool of
+ * 'n_frames' frames and are written to the swap file at 'path' when evicted dirty, so their
+ * contents leave the region until they fault back in. Pages start zero filled.
+ */
+extern void mm_set_swap_file(const char *path);
+
+/* 'mm_set_cleaner()' must be called before 'mm_init()'. A background thread then checks
+ * every 'interval_ms' milliseconds, and after every dirty eviction, whether more than
+ * 'high' percent of the frames are dirty. If so it writes dirty pages back ahead of the
+ * replacement policy's hand until at most 'low' percent are, write-protecting each one.
+ */
+extern void mm_set_cleaner(int low, int high, int interval_ms);
+
+/* 'mm_set_io_cost()' must be called before 'mm_init()'. It sets the modeled microseconds of
+ * reading a page in and of writing a dirty page back, 100 and 300 by default. The cost-aware
+ * policy keeps a dirty page until it is as many times older than the least recently used
+ * clean page as its eviction costs more, and the report prints the modeled I/O time.
+ */
+extern void mm_set_io_cost(int read_us, int write_us);
+
+/* 'mm_set_write_budget()' must be called before 'mm_init()'. Write backs, of evicted and of
+ * cleaned pages, are then capped at 'per_second'. A fault that writes back past the budget
+ * sleeps until the budget allows it, the cleaner stops until the budget has room, and the
+ * cost-aware policy evicts clean pages while it has any. 0 removes the cap.
+ */
+extern void mm_set_write_budget(int per_second);
+
+/* 'mm_set_userfaultfd()' must be called before 'mm_init()'. Faults are then read from a
+ * userfaultfd by a fault thread instead of taken as SIGSEGV, and pages are write-protected
+ * and dropped through it instead of with mprotect. The log is the same as with SIGSEGV.
+ * It cannot be combined with 'mm_set_swap_file()'.
+ */
+extern void mm_set_userfaultfd();
+
+/* 'mm_set_sweep_interval()' must be called before 'mm_init()'. Pages a replacement policy
+ * protects to sample their reference bits are then protected together every 'faults' faults
+ * that reach the policy, one mprotect for each run of consecutive pages, instead of at the
+ * end of every such fault. References made before the sample are not seen. Defaults to 1.
+ */
+extern void mm_set_sweep_interval(int faults);
+
+/* 'mm_set_prefetch()' must be called before 'mm_init()'. Once faults come a steady stride
+ * apart, up to 'max_window' pages along the stride then get frames ahead of their first
+ * reference, mapped read only. Reading them takes no fault and writing them faults with
+ * type 2. Each is logged with type 5. The window doubles when the stream next faults just
+ * past it and halves when a page read ahead is evicted unreferenced.
+ */
+extern void mm_set_prefetch(int max_window);
+
+/* 'mm_set_huge_pages()' must be called before 'mm_init()'. Every run of pages aligned to
+ * 'huge_size' bytes in the address space is then promoted to one huge page once all of its
+ * pages are present and referenced. A huge page is protected, faults and is referenced as a
+ * whole, and is demoted back to base pages when a policy evicts one of them.
+ */
+extern void mm_set_huge_pages(int huge_size);
+
+/* 'mm_add_region()' must be called before 'mm_init()'. It registers another region of
+ * 'vm_size' bytes at 'vm', aligned to the page size, managed as its own process next to the
+ * region passed to 'mm_init()', which is region 0. All regions share the 'n_frames' frames.
+ * Page numbers passed to 'mm_logger()' count on from the pages of the regions before it.
+ * Returns the region number. Not supported by the userfaultfd engine.
+ */
+extern int mm_add_region(void *vm, int vm_size);
+
+/* 'mm_set_frame_allocation()' must be called before 'mm_init()'. It splits the frames between
+ * the regions. 'mode' can take values 0 to 3:
+ *          0 - Global replacement, the policy evicts pages of any region (the default)
+ *          1 - Equal shares, every region evicts its own pages once it fills its share
+ *          2 - Page fault frequency, a region gets another frame when it faults again within
+ *              'window' faults, and gives up the pages it did not use since its last fault
+ *              when it does not
+ *          3 - Working set, every 'window' faults each region's share becomes the number of
+ *              its pages used in that window, resident or not
+ * In modes 2 and 3, when the regions want more frames than there are, the region faulting
+ * most is throttled: its faults are delayed and its pages go to the others until its demand
+ * fits again.
+ */
+extern void mm_set_frame_allocation(int mode, int window);
+
+/* 'mm_set_compressed_tier()' must be called before 'mm_init()' and needs 'mm_set_swap_file()'.
+ * Dirty pages evicted are then compressed into a pool of at most 'max_kb' KiB instead of
+ * written to the swap file, and faults on them decompress them from the pool. Pages of one
+ * repeated word take no pool memory. Pages that compress poorly go to the swap file, as do
+ * the pages stored longest ago when the pool is full.
+ */
+extern void mm_set_compressed_tier(int max_kb);
+
+/* 'mm_set_zero_page()' must be called before 'mm_init()'. A read of a page never written
+ * then maps it read-only to a zero frame shared by all such pages, logged as a fault of type 0
+ * at the frame past the last one without evicting anything. The first write gives it a frame,
+ * logged as a fault of type 2.
+ */
+extern void mm_set_zero_page();
+
+/* 'mm_clone_region()' makes region 'target', of the same size as region 'source' and not yet
+ * accessed, a copy of it. Pages of the source holding a frame then share it with their copy,
+ * both mapped read-only, until either is written. The write is logged as a fault of type 2
+ * giving the writer a frame of its own. The frame stays with the pages that did not write
+ * it, and is unshared when they are evicted. Not supported with 'mm_set_huge_pages()'.
+ */
+extern void mm_clone_region(int source, int target);
+
+/* 'mm_add_numa_node()' must be called before 'mm_init()'. It adds a memory node of 'n_frames'
+ * frames, numbered after those of the nodes added before it. The nodes must add up to the
+ * 'n_frames' of 'mm_init()'. A fault's access to a frame of the node is modeled to cost
+ * 'local_ns' nanoseconds from a thread of the node and 'remote_ns' from any other thread.
+ * Returns the node number. Not supported by the userfaultfd engine.
+ */
+extern int mm_add_numa_node(int n_frames, int local_ns, int remote_ns);
+
+/* 'mm_set_numa_policy()' must be called before 'mm_init()'. 'placement' picks the node a page
+ * gets a frame on while that node has a free one, otherwise the next node with one does:
+ *          0 - First touch, the node of the thread that faulted on it (the default)
+ *          1 - Interleave, node 'virt_page % nodes'
+ * Once every frame is in use, a page takes the frame of the policy's victim. A present page
+ * that faults 'migrate_after' times in a row from threads of other nodes then moves to the
+ * node of the last one, evicting a page there if it is full. 0, the default, never moves pages.
+ */
+extern void mm_set_numa_policy(int placement, int migrate_after);
+
+/* 'mm_set_thread_node()' binds the calling thread to a node added with 'mm_add_numa_node()'.
+ * Threads not bound get the nodes in turn at their first fault.
+ */
+extern void mm_set_thread_node(int node);
+
+// Faults that accessed a frame of the faulting thread's node, of another node, and pages migrated
+extern unsigned long mm_report_nlocal_accesses();
+extern unsigned long mm_report_nremote_accesses();
+extern unsigned long mm_report_nmigrations();
+
+// Reads mapped to the zero frame and pages copied on a write to a shared frame
+extern unsigned long mm_report_nzero_maps();
+extern unsigned long mm_report_ncow_copies();
+
+// Pages stored in the compressed tier and pages faulted back in from it
+extern unsigned long mm_report_ntier_stores();
+extern unsigned long mm_report_ntier_hits();
+
+// Faults on non-present pages of a region, frames it holds and times it was throttled
+extern unsigned long mm_report_region_faults(int region);
+extern int mm_report_region_frames(int region);
+extern unsigned long mm_report_region_throttles(int region);
+
+// Ranges promoted to huge pages and huge pages demoted back to base pages
+extern unsigned long mm_report_nhuge_promotions();
+extern unsigned long mm_report_nhuge_demotions();
+
+// Pages read ahead, those later referenced (hits) and those evicted unreferenced (waste)
+extern unsigned long mm_report_nprefetches();
+extern unsigned long mm_report_nprefetch_hits();
+extern unsigned long mm_report_nprefetch_waste();
 extern void print_stats();
 
-/*
- * UNUSED
-// 'mm_report_npage_faults' should return the total number of page faults of the entire system (across all virtual pages). 
-unsigned long mm_report_npage_faults(); 
-// 'mm_report_nwrite_backs' should return the total number of write backs of the entire system (across all virtual pages). 
-unsigned long mm_report_nwrite_backs();
-*/
+// Power of two buckets of the fault latency histogram, the last also holds every longer fault
+#define  LATENCY_BUCKETS  32
+
+// 'mm_report_npage_faults' returns the total number of page faults of the entire system (across all virtual pages). 
+extern unsigned long mm_report_npage_faults(); 
+// 'mm_report_nwrite_backs' returns the total number of write backs of the entire system (across all virtual pages),
+// both of evicted dirty pages and of pages written back early by the cleaner.
+extern unsigned long mm_report_nwrite_backs();
+// 'mm_report_nfaults' returns the number of page faults of one 'fault_type', as passed to 'mm_logger()'.
+extern unsigned long mm_report_nfaults(int fault_type);
+// 'mm_report_nevictions' returns the number of pages evicted, including those evicted for readahead.
+extern unsigned long mm_report_nevictions();
+// 'mm_report_npage_ins' returns the number of pages given a frame, each modeled as one page read.
+extern unsigned long mm_report_npage_ins();
+// 'mm_report_nthrottled_writes' returns the number of faults that waited for the write back budget.
+extern unsigned long mm_report_nthrottled_writes();
+/* 'mm_report_latency()' copies the fault latency histogram into 'histogram'. Bucket i counts
+ * the faults that took between 2^i and 2^(i+1) - 1 time stamp counter cycles to handle.
+ */
+extern void mm_report_latency(unsigned long histogram[LATENCY_BUCKETS]);
+// 'mm_print_report()' prints the counters above, eviction and write back rates per fault and per second, and the histogram.
+extern void mm_print_report();
 
 #endif
@@ -0,0 +1,700 @@
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "473_policy.h"
+
+#define  AGING_MSB        (1u << 31)
+#define  WSCLOCK_WINDOW   2
+
+/**
+* Data Structures
+*/
+
+// Policy list ids stored in Page.list
+typedef enum {
+    LIST_NONE  = 0,
+    LIST_QUEUE = 1,
+    ARC_T1     = 2,
+    ARC_T2     = 3,
+    ARC_B1     = 4,
+    ARC_B2     = 5,
+    TWOQ_A1IN  = 6,
+    TWOQ_A1OUT = 7,
+    TWOQ_AM    = 8,
+    TWOQ_PROMOTED = 9,
+    COST_CLEAN = 10,
+    COST_DIRTY = 11
+} listId;
+
+// Doubly linked list of pages, oldest at the head
+//  head - Least recently added page
+//  tail - Most recently added page
+//  length - Number of pages in the list
+//  id - listId stored in every page of the list
+typedef struct {
+    Page *head;
+    Page *tail;
+    int length;
+    unsigned char id;
+} PageList;
+
+// FIFO, aging and WSClock state, their hand is the context's hand
+//  window - WSClock working set window in faults
+typedef struct {
+    unsigned int window;
+} ClockState;
+
+// Third chance state
+//  pages - Every page faulted so far, in the order they first faulted
+//  clockIndex - Position in the page list the cycle resumes from
+//  ringTail - Frame of the present page latest in the page list, -1 if none
+//  succ - Frame after the last evicted one, -1 if none
+typedef struct {
+    PageList pages;
+    int clockIndex;
+    int ringTail;
+    int succ;
+} ThirdChanceState;
+
+// ARC state
+//  t1, t2 - Present pages seen once and at least twice, LRU at the head
+//  b1, b2 - Ghost lists of the pages recently evicted from t1 and t2
+//  target - Adaptive target length of t1
+typedef struct {
+    PageList t1, t2, b1, b2;
+    int target;
+} ArcState;
+
+// 2Q state
+//  a1in - FIFO of present pages seen once
+//  a1out - Ghost FIFO of the pages evicted from a1in
+//  am - LRU of present pages seen again after leaving a1in, LRU at the head
+//  kin, kout - Length limits of a1in and a1out
+typedef struct {
+    PageList a1in, a1out, am;
+    int kin;
+    int kout;
+} TwoQState;
+
+// Cost-aware state
+//  clean, dirty - Present pages last seen clean and dirty, LRU at the head
+typedef struct {
+    PageList clean, dirty;
+} CostState;
+
+/**
+* Helper Functions
+*/
+
+/**
+* List Push
+* * Appends a page to the tail of a list
+* @param list the list
+* @param page the page to append
+*/
+static void listPush(PageList *list, Page *page) {
+    page->prev = list->tail;
+    page->next = NULL;
+    if (list->tail == NULL) {
+        list->head = page;
+    } else {
+        list->tail->next = page;
+    }
+    list->tail = page;
+    page->list = list->id;
+    list->length++;
+}
+
+/**
+* List Remove
+* * Unlinks a page from a list
+* @param list the list holding the page
+* @param page the page to unlink
+*/
+static void listRemove(PageList *list, Page *page) {
+    if (page->prev == NULL) {
+        list->head = page->next;
+    } else {
+        page->prev->next = page->next;
+    }
+
+    if (page->next == NULL) {
+        list->tail = page->prev;
+    } else {
+        page->next->prev = page->prev;
+    }
+
+    page->prev = NULL;
+    page->next = NULL;
+    page->list = LIST_NONE;
+    list->length--;
+}
+
+/**
+* List Pop
+* * Unlinks the head of a list
+* @param list the list
+* @return the unlinked page
+*/
+static Page *listPop(PageList *list) {
+    Page *page = list->head;
+    listRemove(list, page);
+    return page;
+}
+
+/**
+* Clock Init
+* * Allocates the state shared by FIFO, aging and WSClock
+* @param ctx the context
+*/
+static void clockInit(MMContext *ctx) {
+    ClockState *state = calloc(1, sizeof(ClockState));
+    if (state == NULL) exit(-1);
+    state->window = WSCLOCK_WINDOW * ctx->nFrames;
+    ctx->state = state;
+}
+
+/**
+* FIFO Policy
+*/
+
+/**
+* FIFO Select Victim
+* * Frames are filled in order, so the frame under the hand always holds the oldest page
+*/
+static int fifoSelectVictim(MMContext *ctx, Page *incoming) {
+    int frame = ctx->hand;
+    ctx->hand = (ctx->hand + 1) % ctx->nFrames;
+    return frame;
+}
+
+static void fifoOnFault(MMContext *ctx, Page *page) {
+}
+
+/**
+* Third Chance Policy
+*/
+
+/**
+* Ring Insert
+* * Links a frame into the clock ring, which holds the present pages in page list order
+* @param ctx the context
+* @param frame the frame to link
+*/
+static void ringInsert(MMContext *ctx, int frame) {
+    ThirdChanceState *state = ctx->state;
+    Frame *frames = ctx->frameTable;
+    if (state->ringTail == -1) {
+        frames[frame].prev = frame;
+        frames[frame].next = frame;
+        state->ringTail = frame;
+        return;
+    }
+
+    // Link after the closest present page before it in the page list,
+    // or in front of the first present page if there is none
+    Page *prevPage = frames[frame].page->prev;
+    while (prevPage != NULL && !(prevPage->flags & PTE_PRESENT)) prevPage = prevPage->prev;
+    int after = prevPage != NULL ? prevPage->pageFrame : state->ringTail;
+
+    frames[frame].prev = after;
+    frames[frame].next = frames[after].next;
+    frames[frames[after].next].prev = frame;
+    frames[after].next = frame;
+    if (prevPage != NULL && after == state->ringTail) state->ringTail = frame;
+}
+
+/**
+* Ring Remove
+* * Unlinks a frame from the clock ring
+* @param ctx the context
+* @param frame the frame to unlink
+*/
+static void ringRemove(MMContext *ctx, int frame) {
+    ThirdChanceState *state = ctx->state;
+    Frame *frames = ctx->frameTable;
+    if (frames[frame].next == frame) {
+        state->ringTail = -1;
+        return;
+    }
+    frames[frames[frame].prev].next = frames[frame].next;
+    frames[frames[frame].next].prev = frames[frame].prev;
+    if (state->ringTail == frame) state->ringTail = frames[frame].prev;
+}
+
+/**
+* Seek Hand
+* * Finds the frame of the first present page at or after clockIndex in the page list,
+* * wrapping to the first present page. Only the successor of the last frame the hand
+* * left and a newly linked frame can be that page.
+* @param ctx the context
+* @param frame frame just linked into the ring
+*/
+static int seekHand(MMContext *ctx, int frame) {
+    ThirdChanceState *state = ctx->state;
+    Frame *frames = ctx->frameTable;
+    int succ = state->succ;
+    if (state->clockIndex > 0) {
+        bool succValid = succ != -1 && frames[succ].page->seq >= state->clockIndex;
+        bool frameValid = frames[frame].page->seq >= state->clockIndex;
+        if (succValid && frameValid) {
+            return frames[frame].page->seq < frames[succ].page->seq ? frame : succ;
+        }
+        if (succValid) return succ;
+        if (frameValid) return frame;
+        state->clockIndex = 0;
+    }
+    return frames[state->ringTail].next;
+}
+
+static void thirdChanceInit(MMContext *ctx) {
+    ThirdChanceState *state = calloc(1, sizeof(ThirdChanceState));
+    if (state == NULL) exit(-1);
+    state->pages.id = LIST_QUEUE;
+    state->ringTail = -1;
+    state->succ = -1;
+    ctx->state = state;
+}
+
+/**
+* Third Chance Select Victim
+* * Sweeps the ring from the hand, protecting every page it passes so its
+* * bits are refreshed by the next reference, until a page is out of chances
+*/
+static int thirdChanceSelectVictim(MMContext *ctx, Page *incoming) {
+    ThirdChanceState *state = ctx->state;
+    Frame *frames = ctx->frameTable;
+    while (true) {
+        Page *nextPage = frames[ctx->hand].page;
+        int succ = frames[ctx->hand].next;
+
+        if (nextPage->flags & PTE_REF) {
+            // First chance, check reference bit
+            pteClear(nextPage, PTE_REF);
+            ctx->protect(ctx, nextPage);
+        } else if ((getWrite(nextPage) & 1 << 1) > 0) {
+            // Second chance, check write first bit
+            setWrite(nextPage, 1);
+            ctx->protect(ctx, nextPage);
+        } else {
+            // Evict current page, the cycle restarts from the head after the last page in the list
+            int frame = ctx->hand;
+            state->clockIndex = nextPage->next == NULL ? 0 : nextPage->seq + 1;
+            ringRemove(ctx, frame);
+            state->succ = succ == frame ? -1 : succ;
+            return frame;
+        }
+
+        // Advance the hand, passing the last present page restarts the cycle
+        state->clockIndex = frames[succ].page->seq > nextPage->seq ? nextPage->seq + 1 : 0;
+        ctx->hand = succ;
+    }
+}
+
+/**
+* Third Chance Release
+* * Unlinks a frame from the ring, moving the hand past it. The page keeps its place in
+* * the page list, as on eviction.
+*/
+static void thirdChanceRelease(MMContext *ctx, Page *page) {
+    ThirdChanceState *state = ctx->state;
+    int frame = page->pageFrame;
+    if (ctx->hand == frame) ctx->hand = ctx->frameTable[frame].next;
+    if (state->succ == frame) state->succ = -1;
+    ringRemove(ctx, frame);
+}
+
+/**
+* Third Chance Move
+* * Relinks a page that moved frames at its place in the ring, keeping the hand on it
+*/
+static void thirdChanceMove(MMContext *ctx, Page *page, int oldFrame) {
+    ThirdChanceState *state = ctx->state;
+    if (state->succ == oldFrame) state->succ = page->pageFrame;
+    ringRemove(ctx, oldFrame);
+    ringInsert(ctx, page->pageFrame);
+    if (ctx->hand == oldFrame) ctx->hand = page->pageFrame;
+}
+
+static void thirdChanceOnFault(MMContext *ctx, Page *page) {
+    ThirdChanceState *state = ctx->state;
+    if (!(page->flags & PTE_QUEUED)) {
+        pteSet(page, PTE_QUEUED);
+        page->seq = state->pages.length;
+        listPush(&state->pages, page);
+    }
+    ringInsert(ctx, page->pageFrame);
+    ctx->hand = seekHand(ctx, page->pageFrame);
+    state->succ = -1;
+}
+
+/**
+* Aging Policy
+*/
+
+/**
+* Aging Select Victim
+* * Shifts the ref bit of every present page into its counter and evicts the
+* * lowest counter, ties going to the first frame after the hand
+*/
+static int agingSelectVictim(MMContext *ctx, Page *incoming) {
+    int victim = -1;
+    for (int i = 0; i < ctx->nFrames; i++) {
+        int frame = (ctx->hand + i) % ctx->nFrames;
+        Page *page = ctx->frameTable[frame].page;
+        page->stamp >>= 1;
+        if (page->flags & PTE_REF) {
+            // A page only loses its protection by faulting, which sets the ref bit
+            page->stamp |= AGING_MSB;
+            pteClear(page, PTE_REF);
+            ctx->protect(ctx, page);
+        }
+        if (victim == -1 || page->stamp < ctx->frameTable[victim].page->stamp) victim = frame;
+    }
+    ctx->hand = (victim + 1) % ctx->nFrames;
+    return victim;
+}
+
+static void agingOnFault(MMContext *ctx, Page *page) {
+    // A page read ahead has no reference yet, so it starts at a neutral age rather than the
+    // lowest, which would make it the next victim before the stream reaches it
+    page->stamp = (page->flags & PTE_PREFETCHED) ? AGING_MSB >> 1 : 0;
+}
+
+/**
+* WSClock Policy
+*/
+
+/**
+* WSClock Select Victim
+* * Sweeps the frames from the hand for up to two cycles. Referenced pages are
+* * stamped with the current time, the first clean page older than the window is
+* * evicted. With no backing store to clean pages ahead of time, the first old
+* * dirty page is taken when there is no such clean page, then the oldest page.
+*/
+static int wsclockSelectVictim(MMContext *ctx, Page *incoming) {
+    ClockState *state = ctx->state;
+    int dirtyVictim = -1;
+    int oldest = -1;
+    for (int i = 0; i < 2 * ctx->nFrames; i++) {
+        int frame = ctx->hand;
+        ctx->hand = (ctx->hand + 1) % ctx->nFrames;
+        Page *page = ctx->frameTable[frame].page;
+
+        if (page->flags & PTE_REF) {
+            pteClear(page, PTE_REF);
+            page->stamp = ctx->now;
+            ctx->protect(ctx, page);
+            continue;
+        }
+        if (ctx->now - page->stamp > state->window) {
+            if ((getWrite(page) & 1) == 0) return frame;
+            if (dirtyVictim == -1) dirtyVictim = frame;
+        }
+        if (oldest == -1 || page->stamp < ctx->frameTable[oldest].page->stamp) oldest = frame;
+    }
+
+    int victim = dirtyVictim != -1 ? dirtyVictim : oldest;
+    ctx->hand = (victim + 1) % ctx->nFrames;
+    return victim;
+}
+
+static void wsclockOnFault(MMContext *ctx, Page *page) {
+    page->stamp = ctx->now;
+}
+
+static void wsclockOnReference(MMContext *ctx, Page *page, bool write) {
+    page->stamp = ctx->now;
+}
+
+/**
+* ARC Policy
+*/
+
+static void arcInit(MMContext *ctx) {
+    ArcState *state = calloc(1, sizeof(ArcState));
+    if (state == NULL) exit(-1);
+    state->t1.id = ARC_T1;
+    state->t2.id = ARC_T2;
+    state->b1.id = ARC_B1;
+    state->b2.id = ARC_B2;
+    ctx->state = state;
+}
+
+/**
+* ARC Replace
+* * Moves the LRU page of t1 or t2 to its ghost list, following the target length of t1
+* @param state the ARC state
+* @param incoming the page being faulted in
+* @return the page to evict
+*/
+static Page *arcReplace(ArcState *state, Page *incoming) {
+    Page *victim;
+    if (state->t1.length > 0 && (state->t1.length > state->target ||
+            (incoming->list == ARC_B2 && state->t1.length == state->target) || state->t2.length == 0)) {
+        victim = listPop(&state->t1);
+        listPush(&state->b1, victim);
+    } else {
+        victim = listPop(&state->t2);
+        listPush(&state->b2, victim);
+    }
+    return victim;
+}
+
+static int arcSelectVictim(MMContext *ctx, Page *incoming) {
+    ArcState *state = ctx->state;
+    int c = ctx->nFrames;
+
+    // A hit in a ghost list moves the target towards the list that missed it
+    if (incoming->list == ARC_B1) {
+        int delta = state->b2.length > state->b1.length ? state->b2.length / state->b1.length : 1;
+        state->target = state->target + delta > c ? c : state->target + delta;
+        return arcReplace(state, incoming)->pageFrame;
+    }
+    if (incoming->list == ARC_B2) {
+        int delta = state->b1.length > state->b2.length ? state->b1.length / state->b2.length : 1;
+        state->target = state->target - delta < 0 ? 0 : state->target - delta;
+        return arcReplace(state, incoming)->pageFrame;
+    }
+
+    // A new page, keep the directory to c pages of history per side
+    if (state->t1.length + state->b1.length >= c) {
+        if (state->t1.length < c) {
+            listPop(&state->b1);
+            return arcReplace(state, incoming)->pageFrame;
+        }
+        return listPop(&state->t1)->pageFrame;
+    }
+    if (state->t1.length + state->t2.length + state->b1.length + state->b2.length >= 2 * c) {
+        listPop(&state->b2);
+    }
+    return arcReplace(state, incoming)->pageFrame;
+}
+
+static void arcOnFault(MMContext *ctx, Page *page) {
+    ArcState *state = ctx->state;
+    if (page->list == ARC_B1) {
+        listRemove(&state->b1, page);
+        listPush(&state->t2, page);
+    } else if (page->list == ARC_B2) {
+        listRemove(&state->b2, page);
+        listPush(&state->t2, page);
+    } else {
+        listPush(&state->t1, page);
+    }
+}
+
+static void arcOnReference(MMContext *ctx, Page *page, bool write) {
+    ArcState *state = ctx->state;
+    if (page->list == ARC_T1) {
+        listRemove(&state->t1, page);
+        listPush(&state->t2, page);
+    } else if (page->list == ARC_T2) {
+        listRemove(&state->t2, page);
+        listPush(&state->t2, page);
+    }
+}
+
+/**
+* ARC Release
+* * Moves a present page to the ghost list of its side, as if replaced
+*/
+static void arcRelease(MMContext *ctx, Page *page) {
+    ArcState *state = ctx->state;
+    int c = ctx->nFrames;
+    if (page->list == ARC_T1) {
+        listRemove(&state->t1, page);
+        listPush(&state->b1, page);
+    } else if (page->list == ARC_T2) {
+        listRemove(&state->t2, page);
+        listPush(&state->b2, page);
+    }
+
+    // Keep the directory to c pages of history per side
+    while (state->b1.length > 0 && state->t1.length + state->b1.length > c) listPop(&state->b1);
+    while (state->b2.length > 0 && state->t1.length + state->t2.length + state->b1.length + state->b2.length > 2 * c) {
+        listPop(&state->b2);
+    }
+}
+
+/**
+* 2Q Policy
+*/
+
+static void twoQInit(MMContext *ctx) {
+    TwoQState *state = calloc(1, sizeof(TwoQState));
+    if (state == NULL) exit(-1);
+    state->a1in.id = TWOQ_A1IN;
+    state->a1out.id = TWOQ_A1OUT;
+    state->am.id = TWOQ_AM;
+    state->kin = ctx->nFrames / 4 > 0 ? ctx->nFrames / 4 : 1;
+    state->kout = ctx->nFrames / 2 > 0 ? ctx->nFrames / 2 : 1;
+    ctx->state = state;
+}
+
+static int twoQSelectVictim(MMContext *ctx, Page *incoming) {
+    TwoQState *state = ctx->state;
+
+    // Take the incoming page out of a1out first so trimming cannot forget it
+    if (incoming->list == TWOQ_A1OUT) {
+        listRemove(&state->a1out, incoming);
+        incoming->list = TWOQ_PROMOTED;
+    }
+
+    if (state->a1in.length > state->kin || state->am.length == 0) {
+        Page *victim = listPop(&state->a1in);
+        listPush(&state->a1out, victim);
+        if (state->a1out.length > state->kout) listPop(&state->a1out);
+        return victim->pageFrame;
+    }
+    return listPop(&state->am)->pageFrame;
+}
+
+static void twoQOnFault(MMContext *ctx, Page *page) {
+    TwoQState *state = ctx->state;
+    // A page placed in a frame the pager freed was not seen by selectVictim
+    if (page->list == TWOQ_A1OUT) {
+        listRemove(&state->a1out, page);
+        page->list = TWOQ_PROMOTED;
+    }
+    if (page->list == TWOQ_PROMOTED) {
+        listPush(&state->am, page);
+    } else {
+        listPush(&state->a1in, page);
+    }
+}
+
+static void twoQOnReference(MMContext *ctx, Page *page, bool write) {
+    TwoQState *state = ctx->state;
+    if (page->list == TWOQ_AM) {
+        listRemove(&state->am, page);
+        listPush(&state->am, page);
+    }
+}
+
+/**
+* 2Q Release
+* * Moves a page of a1in to a1out, as if replaced, and drops a page of am
+*/
+static void twoQRelease(MMContext *ctx, Page *page) {
+    TwoQState *state = ctx->state;
+    if (page->list == TWOQ_A1IN) {
+        listRemove(&state->a1in, page);
+        listPush(&state->a1out, page);
+        if (state->a1out.length > state->kout) listPop(&state->a1out);
+    } else if (page->list == TWOQ_AM) {
+        listRemove(&state->am, page);
+    }
+}
+
+/**
+* Cost-Aware Policy
+*/
+
+static void costInit(MMContext *ctx) {
+    CostState *state = calloc(1, sizeof(CostState));
+    if (state == NULL) exit(-1);
+    state->clean.id = COST_CLEAN;
+    state->dirty.id = COST_DIRTY;
+    ctx->state = state;
+}
+
+/**
+* Eviction Cost
+* * The I/O evicting a page costs, a page in when it is used again and a write back if dirty
+* @param ctx the context
+* @param page the page
+*/
+static unsigned long long evictionCost(MMContext *ctx, Page *page) {
+    return ctx->readCost + ((getWrite(page) & 1) ? ctx->writeCost : 0);
+}
+
+/**
+* Cost Link
+* * Appends a page to the list of its dirty bit, stamped with the current time
+* @param ctx the context
+* @param page the page
+*/
+static void costLink(MMContext *ctx, Page *page) {
+    CostState *state = ctx->state;
+    page->stamp = ctx->now;
+    listPush((getWrite(page) & 1) ? &state->dirty : &state->clean, page);
+}
+
+/**
+* Cost-Aware Select Victim
+* * Weighs the LRU page of each list by its age per unit of I/O its eviction costs and
+* * evicts the one that gives back the most, so a dirty page stays until it is as many
+* * times older than the LRU clean page as its eviction costs more. While write backs are
+* * past their budget a clean page goes first. Pages the cleaner wrote back stay in the
+* * dirty list until seen again and weigh as clean.
+*/
+static int costSelectVictim(MMContext *ctx, Page *incoming) {
+    CostState *state = ctx->state;
+    Page *clean = state->clean.head;
+    Page *dirty = state->dirty.head;
+    Page *victim;
+    if (clean == NULL || dirty == NULL) {
+        victim = clean != NULL ? clean : dirty;
+    } else if (ctx->writesThrottled && (getWrite(dirty) & 1)) {
+        victim = clean;
+    } else {
+        unsigned long long cleanAge = ctx->now - clean->stamp + 1ULL;
+        unsigned long long dirtyAge = ctx->now - dirty->stamp + 1ULL;
+        victim = dirtyAge * evictionCost(ctx, clean) > cleanAge * evictionCost(ctx, dirty) ? dirty : clean;
+    }
+    listRemove(victim->list == COST_CLEAN ? &state->clean : &state->dirty, victim);
+    return victim->pageFrame;
+}
+
+static void costOnFault(MMContext *ctx, Page *page) {
+    costLink(ctx, page);
+}
+
+static void costOnReference(MMContext *ctx, Page *page, bool write) {
+    CostState *state = ctx->state;
+    if (page->list == COST_CLEAN || page->list == COST_DIRTY) {
+        listRemove(page->list == COST_CLEAN ? &state->clean : &state->dirty, page);
+        costLink(ctx, page);
+    }
+}
+
+/**
+* Cost-Aware Release
+* * Unlinks a page from its list
+*/
+static void costRelease(MMContext *ctx, Page *page) {
+    CostState *state = ctx->state;
+    if (page->list == COST_CLEAN || page->list == COST_DIRTY) {
+        listRemove(page->list == COST_CLEAN ? &state->clean : &state->dirty, page);
+    }
+}
+
+/**
+* Policy Table
+*/
+
+static const MMPolicy policies[] = {
+    {"FIFO", clockInit, fifoSelectVictim, fifoOnFault, NULL, false, NULL, NULL},
+    {"Third Chance", thirdChanceInit, thirdChanceSelectVictim, thirdChanceOnFault, NULL, false, thirdChanceRelease, thirdChanceMove},
+    {"Aging LRU", clockInit, agingSelectVictim, agingOnFault, NULL, false, NULL, NULL},
+    {"WSClock", clockInit, wsclockSelectVictim, wsclockOnFault, wsclockOnReference, false, NULL, NULL},
+    {"ARC", arcInit, arcSelectVictim, arcOnFault, arcOnReference, true, arcRelease, NULL},
+    {"2Q", twoQInit, twoQSelectVictim, twoQOnFault, twoQOnReference, true, twoQRelease, NULL},
+    {"Cost-Aware", costInit, costSelectVictim, costOnFault, costOnReference, true, costRelease, NULL}
+};
+
+/**
+* Main Functions
+*/
+
+/**
+* Get Policy
+* * Looks up a replacement policy by its number
+* @param policy policy number, 1 to 7
+*/
+const MMPolicy *mm_get_policy(int policy) {
+    if (policy < 1 || policy > (int)(sizeof(policies) / sizeof(policies[0]))) return NULL;
+    return &policies[policy - 1];
+}
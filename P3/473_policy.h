@@ -0,0 +1,188 @@
+// 473_policy.h
+// Description: Page table, frame table and the page replacement policy
+//              interface shared by the pager and its policies
+
+#ifndef _473_POLICY_H
+#define _473_POLICY_H
+
+#include <stdbool.h>
+
+/**
+* Data Structures
+*/
+
+// Page table entry flags
+//  PTE_PRESENT - Page holds a physical frame
+//  PTE_READONLY - Flag set for when mprotect is in ReadOnly
+//  PTE_REF - The ref bit, set on every fault on the page
+//  PTE_WRITE - The 2-bit write field, the low bit marks the page dirty
+//  PTE_QUEUED - Page is linked in the page list of the third chance policy
+//  PTE_SWAPPED - Page has a copy in the swap file
+//  PTE_WRITABLE - Page is mapped with write access
+//  PTE_PREFETCHED - Page was read ahead and has not been referenced yet
+//  PTE_MAPPED - Page is accessible, with the userfaultfd engine also populated in the region
+//  PTE_PENDING - A policy asked for the page to be protected at the next reference sample
+//  PTE_HUGE - Page is part of a range promoted to a huge page
+//  PTE_USED - Page was referenced since the frame allocation last sampled its region
+//  PTE_ZERO - Page holds no frame and is mapped read-only to the shared zero frame
+//  PTE_SHARED - Page maps a frame shared copy-on-write with other pages, as its owner
+//               (also PTE_PRESENT) or as one of its sharers
+//  PTE_DATA - Page was written or cloned, so its contents may not be zero
+typedef enum {
+    PTE_PRESENT  = 1 << 0,
+    PTE_READONLY = 1 << 1,
+    PTE_REF      = 1 << 2,
+    PTE_WRITE    = 3 << 3,
+    PTE_QUEUED   = 1 << 5,
+    PTE_SWAPPED  = 1 << 6,
+    PTE_WRITABLE = 1 << 7,
+    PTE_PREFETCHED = 1 << 8,
+    PTE_MAPPED   = 1 << 9,
+    PTE_PENDING  = 1 << 10,
+    PTE_HUGE     = 1 << 11,
+    PTE_USED     = 1 << 12,
+    PTE_ZERO     = 1 << 13,
+    PTE_SHARED   = 1 << 14,
+    PTE_DATA     = 1 << 15
+} pteFlag;
+
+#define  PTE_WRITE_SHIFT  3
+
+// Modeled microseconds to read a page in and to write a dirty page back
+#define  DEFAULT_READ_US   100
+#define  DEFAULT_WRITE_US  300
+
+// Page info, one entry of the page table for every virtual page
+//  prev - Previous page in the policy's linked list
+//  next - Next page in the policy's linked list
+//  seq - Position of the page in the page list
+//  pageFrame - The frame number in physical memory, -1 if not
+//  stamp - Aging counter or last use time, owned by the policy
+//  flags - Packed pteFlag bits, changed atomically with pteSet, pteClear and setWrite
+//  list - Policy list the page is linked in, 0 if none
+//  lock - Held by the thread handling a fault on the page or changing its mapping
+typedef struct Page {
+    struct Page *prev;
+    struct Page *next;
+    int seq;
+    int pageFrame;
+    unsigned int stamp;
+    unsigned short flags;
+    unsigned char list;
+    volatile char lock;
+} Page;
+
+// Frame info, one entry of the circular frame table for every physical frame
+//  page - Back-pointer to the page held by the frame
+//  prev - Previous frame of the clock ring
+//  next - Next frame of the clock ring
+typedef struct {
+    Page *page;
+    int prev;
+    int next;
+} Frame;
+
+// State handed to every policy call
+//  pageTable - Page table indexed by virtual page number
+//  nPages - Number of virtual pages
+//  frameTable - Frame table indexed by frame number
+//  nFrames - Number of physical frames
+//  now - Number of faults handled so far, the policies' virtual time
+//  hand - Frame the policy's next sweep starts from, 0 for policies without a hand
+//  readCost, writeCost - Modeled I/O time of reading a page in and of writing a dirty page back
+//  writesThrottled - Write backs ran past their budget, so a clean victim is better
+//  protect - Revokes access to a present page so its next reference faults, no later than
+//            the end of the fault being handled unless reference sampling is less frequent
+//  state - Private state of the policy
+typedef struct MMContext {
+    Page *pageTable;
+    int nPages;
+    Frame *frameTable;
+    int nFrames;
+    unsigned int now;
+    int hand;
+    int readCost;
+    int writeCost;
+    bool writesThrottled;
+    void (*protect)(struct MMContext *ctx, Page *page);
+    void *state;
+} MMContext;
+
+// Page replacement policy
+//  name - Name printed in reports
+//  init - Allocates the policy state, called once all frames are free
+//  selectVictim - Picks the present page to evict for 'incoming' once every frame is
+//                 full, unlinks it from the policy's resident structures and returns its frame
+//  onFault - Called after 'page' is placed in its frame on a fault on a non-present page
+//  onReference - Called on a fault on a present page, NULL if the policy ignores them
+//  trackReferences - The pager revokes access to the page of a thread's last fault at its
+//                    next fault, so that onReference sees every later reference to it
+//  release - Unlinks a present page the pager evicts without asking selectVictim from the
+//            policy's resident structures, NULL if the policy only keeps frame order. Its
+//            frame stays free until a later fault fills it, before selectVictim is next called.
+//  move - Called after the pager moved a present page from 'oldFrame' to its current frame,
+//         which was free, NULL if the policy keeps no order of its own over frames
+typedef struct {
+    const char *name;
+    void (*init)(MMContext *ctx);
+    int (*selectVictim)(MMContext *ctx, Page *incoming);
+    void (*onFault)(MMContext *ctx, Page *page);
+    void (*onReference)(MMContext *ctx, Page *page, bool write);
+    bool trackReferences;
+    void (*release)(MMContext *ctx, Page *page);
+    void (*move)(MMContext *ctx, Page *page, int oldFrame);
+} MMPolicy;
+
+/**
+* Helper Functions
+*/
+
+/**
+* PTE Set
+* * Sets flags of a page, atomically as other threads may change other flags of it
+* @param page the page table entry
+* @param bits the pteFlag bits to set
+*/
+static inline void pteSet(Page *page, int bits) {
+    __atomic_fetch_or(&page->flags, bits, __ATOMIC_RELAXED);
+}
+
+/**
+* PTE Clear
+* * Clears flags of a page atomically
+* @param page the page table entry
+* @param bits the pteFlag bits to clear
+*/
+static inline void pteClear(Page *page, int bits) {
+    __atomic_fetch_and(&page->flags, ~bits, __ATOMIC_RELAXED);
+}
+
+/**
+* Get Write
+* * Reads the 2-bit write field of a page
+* @param page the page table entry
+*/
+static inline int getWrite(Page *page) {
+    return (page->flags & PTE_WRITE) >> PTE_WRITE_SHIFT;
+}
+
+/**
+* Set Write
+* * Sets the 2-bit write field of a page
+* @param page the page table entry
+* @param write the new value of the field
+*/
+static inline void setWrite(Page *page, int write) {
+    unsigned short flags = __atomic_load_n(&page->flags, __ATOMIC_RELAXED);
+    unsigned short updated;
+    do {
+        updated = (flags & ~PTE_WRITE) | ((write << PTE_WRITE_SHIFT) & PTE_WRITE);
+    } while (!__atomic_compare_exchange_n(&page->flags, &flags, updated, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* 'mm_get_policy()' returns the policy with the given number, NULL if there is none.
+ *  1 - FIFO, 2 - Third chance, 3 - Aging LRU, 4 - WSClock, 5 - ARC, 6 - 2Q, 7 - Cost-aware
+ */
+extern const MMPolicy *mm_get_policy(int policy);
+
+#endif
@@ -0,0 +1,218 @@
+// Include files
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include "473_swap.h"
+#include "473_ztier.h"
+
+#define  QUEUE_SLOTS      64
+#define  FULL_WAIT_NS     10000
+
+/**
+* Data Structures
+*/
+
+// Write queue entry
+//  page - Virtual page number, which is also the page's slot in the swap file
+typedef struct {
+    int page;
+} WriteEntry;
+
+/**
+* Global Variables
+*/
+
+int swapFd = -1;
+int frameFd = -1;
+int swapPageSize = -1;
+int zeroFrame = -1;
+char *framePool = NULL;
+
+// Single producer (the fault handler, or the cleaner under the pager lock),
+// single consumer (the writer thread) ring.
+// Slot i of the ring owns page buffer i of writeBuffers.
+WriteEntry writeQueue[QUEUE_SLOTS];
+char *writeBuffers = NULL;
+unsigned int queueHead = 0;
+unsigned int queueTail = 0;
+sem_t queueWork;
+pthread_t writerThread;
+
+unsigned long swapPageIns = 0;
+unsigned long swapPageOuts = 0;
+
+/**
+* Helper Functions
+*/
+
+/**
+* Write Buffer
+* * Finds the page buffer owned by a queue position
+* @param position queue position
+*/
+static inline char *writeBuffer(unsigned int position) {
+    return writeBuffers + (size_t)(position % QUEUE_SLOTS) * swapPageSize;
+}
+
+/**
+* Find Pending
+* * Finds the latest queued write of a page not yet completed by the writer
+* @param page virtual page number
+* @return the page buffer holding the write, NULL if there is none
+*/
+static char *findPending(int page) {
+    unsigned int tail = __atomic_load_n(&queueTail, __ATOMIC_ACQUIRE);
+    for (unsigned int position = queueHead; position != tail; position--) {
+        if (writeQueue[(position - 1) % QUEUE_SLOTS].page == page) return writeBuffer(position - 1);
+    }
+    return NULL;
+}
+
+/**
+* Writer
+* * Drains the write queue, writing each run of consecutive pages with one pwritev
+* @param arg unused
+*/
+static void *writer(void *arg) {
+    struct iovec iov[QUEUE_SLOTS];
+    while (true) {
+        sem_wait(&queueWork);
+        unsigned int head = __atomic_load_n(&queueHead, __ATOMIC_ACQUIRE);
+        unsigned int position = queueTail;
+        while (position != head) {
+            int first = writeQueue[position % QUEUE_SLOTS].page;
+            int count = 0;
+            do {
+                iov[count].iov_base = writeBuffer(position + count);
+                iov[count].iov_len = swapPageSize;
+                count++;
+            } while (position + count != head && count < QUEUE_SLOTS &&
+                     writeQueue[(position + count) % QUEUE_SLOTS].page == first + count);
+
+            if (pwritev(swapFd, iov, count, (off_t)first * swapPageSize) != (ssize_t)count * swapPageSize) {
+                perror("swap write");
+                exit(-1);
+            }
+
+            // Release the slots only once they are on disk
+            position += count;
+            __atomic_store_n(&queueTail, position, __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+/**
+* Main Functions
+*/
+
+int swapInit(const char *path, int page_size, int n_frames) {
+    swapPageSize = page_size;
+
+    swapFd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (swapFd < 0) return -1;
+
+    // The frame pool stands in for physical memory, frames are mapped into the region from it.
+    // One more frame past the others stays zero filled, to be mapped read-only by many pages.
+    zeroFrame = n_frames;
+    frameFd = memfd_create("473_frames", 0);
+    if (frameFd < 0 || ftruncate(frameFd, (off_t)(n_frames + 1) * page_size) != 0) return -1;
+    framePool = mmap(NULL, (size_t)(n_frames + 1) * page_size, PROT_READ | PROT_WRITE, MAP_SHARED, frameFd, 0);
+    if (framePool == MAP_FAILED) return -1;
+
+    writeBuffers = mmap(NULL, (size_t)QUEUE_SLOTS * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (writeBuffers == MAP_FAILED) return -1;
+
+    if (sem_init(&queueWork, 0, 0) != 0) return -1;
+
+    // The writer must not take the pager's faults
+    sigset_t blocked, previous;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+    int error = pthread_create(&writerThread, NULL, writer, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (error != 0) return -1;
+    pthread_detach(writerThread);
+    return 0;
+}
+
+char *swapFrame(int frame) {
+    return framePool + (size_t)frame * swapPageSize;
+}
+
+void swapPageIn(char *addr, int page, int frame, int prot, bool swapped) {
+    char *frameAddr = swapFrame(frame);
+    if (swapped) {
+        // A copy in the compressed tier is the newest, as writes to the file drop it.
+        // Otherwise a write still in the queue holds newer data than the file.
+        if (!tierLoad(page, frameAddr)) {
+            char *pending = findPending(page);
+            if (pending != NULL) {
+                memcpy(frameAddr, pending, swapPageSize);
+            } else if (pread(swapFd, frameAddr, swapPageSize, (off_t)page * swapPageSize) != swapPageSize) {
+                exit(-1);
+            }
+        }
+        swapPageIns++;
+    } else {
+        memset(frameAddr, 0, swapPageSize);
+    }
+    swapMapFrame(addr, frame, prot);
+}
+
+void swapMapFrame(char *addr, int frame, int prot) {
+    if (mmap(addr, swapPageSize, prot, MAP_SHARED | MAP_FIXED, frameFd, (off_t)frame * swapPageSize) == MAP_FAILED) exit(-1);
+}
+
+void swapMapZero(char *addr) {
+    swapMapFrame(addr, zeroFrame, PROT_READ);
+}
+
+void swapCopyPage(int from, int to, char *buffer) {
+    if (!tierLoad(from, buffer)) {
+        char *pending = findPending(from);
+        if (pending != NULL) {
+            memcpy(buffer, pending, swapPageSize);
+        } else if (pread(swapFd, buffer, swapPageSize, (off_t)from * swapPageSize) != swapPageSize) {
+            exit(-1);
+        }
+    }
+    tierDrop(to);
+    swapQueueCopy(to, buffer);
+}
+
+void swapQueueCopy(int page, const char *data) {
+    // Wait for the writer to free a slot when the queue is full
+    struct timespec wait = {0, FULL_WAIT_NS};
+    while (queueHead - __atomic_load_n(&queueTail, __ATOMIC_ACQUIRE) == QUEUE_SLOTS) nanosleep(&wait, NULL);
+
+    memcpy(writeBuffer(queueHead), data, swapPageSize);
+    writeQueue[queueHead % QUEUE_SLOTS].page = page;
+    __atomic_store_n(&queueHead, queueHead + 1, __ATOMIC_RELEASE);
+    sem_post(&queueWork);
+    swapPageOuts++;
+}
+
+void swapQueueWrite(int page, int frame) {
+    tierDrop(page);
+    swapQueueCopy(page, swapFrame(frame));
+}
+
+void swapPageOut(char *addr, int page, int frame, bool dirty) {
+    // Leave an inaccessible hole so the next access faults the page back in. It goes in
+    // first so no other thread can write the frame while it is copied.
+    if (mmap(addr, swapPageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0) == MAP_FAILED) exit(-1);
+
+    // The compressed tier takes the page unless it compresses poorly or the tier is off
+    if (dirty && !tierStore(page, swapFrame(frame))) swapQueueWrite(page, frame);
+}
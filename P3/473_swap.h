@@ -0,0 +1,52 @@
+// 473_swap.h
+// Description: Swap file backing store and memfd frame pool for the pager
+
+#ifndef _473_SWAP_H
+#define _473_SWAP_H
+
+#include <stdbool.h>
+
+// Pages moved by the backing store, read by the pager's reporting functions
+extern unsigned long swapPageIns;
+extern unsigned long swapPageOuts;
+
+/* 'swapInit()' creates the frame pool of 'n_frames' frames, opens 'path' as the swap
+ * file and starts the writer thread. Returns 0 on success, -1 otherwise.
+ */
+extern int swapInit(const char *path, int page_size, int n_frames);
+
+/* 'swapPageIn()' fills 'frame' with the contents of virtual page 'page' and maps it at
+ * 'addr' with protection 'prot'. Pages never written out ('swapped' false) are zero filled.
+ */
+extern void swapPageIn(char *addr, int page, int frame, int prot, bool swapped);
+
+/* 'swapMapFrame()' maps 'frame' at 'addr' with protection 'prot', leaving its contents. */
+extern void swapMapFrame(char *addr, int frame, int prot);
+
+/* 'swapMapZero()' maps the zero frame, kept past the other frames, read-only at 'addr'. */
+extern void swapMapZero(char *addr);
+
+/* 'swapCopyPage()' queues the contents of swapped out virtual page 'from' as those of page
+ * 'to', through 'buffer' of one page. Callers must not queue concurrently.
+ */
+extern void swapCopyPage(int from, int to, char *buffer);
+
+/* 'swapPageOut()' unmaps 'frame' from 'addr', first queueing a copy of it for the
+ * writer thread when 'dirty'. The frame can be reused as soon as this returns.
+ */
+extern void swapPageOut(char *addr, int page, int frame, bool dirty);
+
+/* 'swapQueueWrite()' queues a copy of 'frame' for the writer thread as the contents of
+ * virtual page 'page', leaving the frame mapped. Callers must not queue concurrently.
+ */
+extern void swapQueueWrite(int page, int frame);
+
+/* 'swapQueueCopy()' queues a copy of the page at 'data' for the writer thread as the
+ * contents of virtual page 'page'. Callers must not queue concurrently.
+ */
+extern void swapQueueCopy(int page, const char *data);
+
+/* 'swapFrame()' returns the address of a frame in the frame pool. */
+extern char *swapFrame(int frame);
+
+#endif
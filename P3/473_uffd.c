@@ -0,0 +1,137 @@
+// Include files
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#include "473_uffd.h"
+
+/**
+* Global Variables
+*/
+
+int uffd = -1;
+int uffdPageSize = -1;
+
+// Holds the contents of pages while they are dropped from the region
+char *backing = NULL;
+
+void (*faultHandler)(char *addr, bool write, int tid) = NULL;
+pthread_t faultThread;
+
+/**
+* Helper Functions
+*/
+
+/**
+* Fault Reader
+* * Reads fault messages from the userfaultfd and hands each fault to the pager
+* @param arg unused
+*/
+static void *faultReader(void *arg) {
+    struct uffd_msg msg;
+    while (true) {
+        ssize_t n = read(uffd, &msg, sizeof(msg));
+        if (n != sizeof(msg)) {
+            if (n < 0 && errno == EINTR) continue;
+            perror("userfaultfd read");
+            exit(-1);
+        }
+        if (msg.event != UFFD_EVENT_PAGEFAULT) continue;
+        faultHandler((char *)msg.arg.pagefault.address, msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE,
+                     msg.arg.pagefault.feat.ptid);
+
+        // Wake the faulting thread only once the pager is done, as returning from a signal would
+        unsigned long page = msg.arg.pagefault.address & ~((unsigned long)uffdPageSize - 1);
+        struct uffdio_range range = {.start = page, .len = uffdPageSize};
+        if (ioctl(uffd, UFFDIO_WAKE, &range) != 0) exit(-1);
+    }
+    return NULL;
+}
+
+/**
+* Main Functions
+*/
+
+int uffdInit(char *start, int size, int page_size, void (*fault)(char *addr, bool write, int tid)) {
+    uffdPageSize = page_size;
+    faultHandler = fault;
+
+    uffd = syscall(SYS_userfaultfd, O_CLOEXEC | UFFD_USER_MODE_ONLY);
+    if (uffd < 0) return -1;
+    struct uffdio_api api = {.api = UFFD_API, .features = UFFD_FEATURE_PAGEFAULT_FLAG_WP | UFFD_FEATURE_EXACT_ADDRESS | UFFD_FEATURE_THREAD_ID};
+    if (ioctl(uffd, UFFDIO_API, &api) != 0) return -1;
+
+    backing = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (backing == MAP_FAILED) return -1;
+    memcpy(backing, start, size);
+
+    struct uffdio_register reg = {
+        .range = {.start = (unsigned long)start, .len = size},
+        .mode = UFFDIO_REGISTER_MODE_MISSING | UFFDIO_REGISTER_MODE_WP
+    };
+    if (ioctl(uffd, UFFDIO_REGISTER, &reg) != 0) return -1;
+    if (madvise(start, size, MADV_DONTNEED) != 0) return -1;
+
+    // The fault thread must not take signals meant for the guest
+    sigset_t blocked, previous;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+    int error = pthread_create(&faultThread, NULL, faultReader, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (error != 0) return -1;
+    pthread_detach(faultThread);
+    return 0;
+}
+
+void uffdSetProtection(char *addr, int page, int prot, bool mapped, bool writable) {
+    char *slot = backing + (size_t)page * uffdPageSize;
+    if (prot == PROT_NONE) {
+        if (mapped) {
+            // Keep the contents, the next access is a missing page fault. Other threads
+            // must not write the page between the copy and the drop.
+            if (writable) {
+                struct uffdio_writeprotect wp = {
+                    .range = {.start = (unsigned long)addr, .len = uffdPageSize},
+                    .mode = UFFDIO_WRITEPROTECT_MODE_WP
+                };
+                if (ioctl(uffd, UFFDIO_WRITEPROTECT, &wp) != 0) exit(-1);
+            }
+            memcpy(slot, addr, uffdPageSize);
+            if (madvise(addr, uffdPageSize, MADV_DONTNEED) != 0) exit(-1);
+        }
+        return;
+    }
+
+    if (!mapped) {
+        // Mapping write protected makes the first write a write-protect fault
+        struct uffdio_copy copy = {
+            .dst = (unsigned long)addr,
+            .src = (unsigned long)slot,
+            .len = uffdPageSize,
+            .mode = UFFDIO_COPY_MODE_DONTWAKE | ((prot & PROT_WRITE) ? 0 : UFFDIO_COPY_MODE_WP)
+        };
+        if (ioctl(uffd, UFFDIO_COPY, &copy) != 0) {
+            perror("userfaultfd copy");
+            exit(-1);
+        }
+    } else if (writable != ((prot & PROT_WRITE) != 0)) {
+        struct uffdio_writeprotect wp = {
+            .range = {.start = (unsigned long)addr, .len = uffdPageSize},
+            .mode = (prot & PROT_WRITE) ? UFFDIO_WRITEPROTECT_MODE_DONTWAKE : UFFDIO_WRITEPROTECT_MODE_WP
+        };
+        if (ioctl(uffd, UFFDIO_WRITEPROTECT, &wp) != 0) {
+            perror("userfaultfd writeprotect");
+            exit(-1);
+        }
+    }
+}
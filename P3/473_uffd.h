@@ -0,0 +1,24 @@
+// 473_uffd.h
+// Description: Userfaultfd fault engine for the pager, an alternative to SIGSEGV and mprotect
+
+#ifndef _473_UFFD_H
+#define _473_UFFD_H
+
+#include <stdbool.h>
+
+/* 'uffdInit()' registers the region of 'size' bytes at 'start' with a userfaultfd for
+ * missing and write-protect faults, saves its contents to a backing area and drops its pages.
+ * A fault thread then calls 'fault' with the exact faulting address of every fault and the
+ * id of the thread that faulted, and wakes the faulting thread once 'fault' returns.
+ * Returns 0 on success, -1 otherwise.
+ */
+extern int uffdInit(char *start, int size, int page_size, void (*fault)(char *addr, bool write, int tid));
+
+/* 'uffdSetProtection()' gives virtual page 'page' at 'addr' the access 'prot' allows,
+ * without waking threads waiting on it. 'mapped' and 'writable' are the page's current state.
+ * Revoking all access saves the page to the backing area and drops it, mapping it copies
+ * it back.
+ */
+extern void uffdSetProtection(char *addr, int page, int prot, bool mapped, bool writable);
+
+#endif
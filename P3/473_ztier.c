@@ -0,0 +1,454 @@
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <x86intrin.h>
+#include "473_ztier.h"
+#include "473_swap.h"
+
+#define  LZ_MIN_MATCH     4
+#define  LZ_HASH_BITS     12
+#define  LZ_MAX_OFFSET    65535
+#define  CLASS_BYTES      64
+#define  SLAB_PAGES       4
+
+/**
+* Data Structures
+*/
+
+// Slab of the pool, holding objects of one size class
+//  sizeClass - Size class of its objects, -1 while the slab is free
+//  used - Objects allocated
+//  carved - Objects handed out at least once, the ones after it were never used
+//  freeObject - First object freed and not reused, -1 if none
+//  prev, next - Neighbours in its class's list of slabs with room, or in the free slab list
+typedef struct {
+    int sizeClass;
+    int used;
+    int carved;
+    int freeObject;
+    int prev;
+    int next;
+} Slab;
+
+// Copy of a page in the tier
+//  stored - The tier holds a copy of the page
+//  sameFilled - The page is one word repeated, kept in fill without pool memory
+//  fill - The repeated word
+//  slab, object - Where the compressed copy is
+//  length - Compressed size in bytes
+//  prev, next - Neighbours in the order copies were stored, oldest first
+typedef struct {
+    bool stored;
+    bool sameFilled;
+    unsigned long fill;
+    int slab;
+    int object;
+    int length;
+    int prev;
+    int next;
+} TierEntry;
+
+/**
+* Global Variables
+*/
+
+int tierPageSize = -1;
+int slabSize = -1;
+int nClasses = 0;
+int maxObject = 0;
+
+char *tierArena = NULL;
+Slab *tierSlabs = NULL;
+int nTierSlabs = 0;
+int *classSlabs = NULL;
+int freeSlabs = -1;
+int slabsUsed = 0;
+
+TierEntry *tierEntries = NULL;
+int tierOldest = -1;
+int tierNewest = -1;
+unsigned long tierPages = 0;
+unsigned long tierBytesStored = 0;
+
+// Scratch pages, the tier is only used under the pager lock
+unsigned char *tierCompressed = NULL;
+char *tierScratch = NULL;
+
+unsigned long tierStores = 0;
+unsigned long tierSameFilled = 0;
+unsigned long tierRejected = 0;
+unsigned long tierWriteBacks = 0;
+unsigned long tierHits = 0;
+unsigned long long tierCompressCycles = 0;
+unsigned long long tierDecompressCycles = 0;
+unsigned long tierCompressions = 0;
+unsigned long tierDecompressions = 0;
+
+/**
+* Helper Functions
+*/
+
+static inline uint32_t read32(const unsigned char *at) {
+    uint32_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+/**
+* LZ Emit
+* * Appends one sequence in the LZ4 block layout: a token with the literal count and match
+* * length in its nibbles, the literals, then the match offset and extra length bytes.
+* * A match length of 0 ends the block after the literals.
+* @return the new output length, -1 if it would pass the capacity
+*/
+static int lzEmit(unsigned char *dst, int out, int capacity, const unsigned char *literals, int nLiterals, int offset, int match) {
+    int extra = match > 0 ? match - LZ_MIN_MATCH : 0;
+    if (out + 1 + nLiterals / 255 + 1 + nLiterals + 2 + extra / 255 + 1 > capacity) return -1;
+    unsigned char *token = &dst[out++];
+    *token = (nLiterals < 15 ? nLiterals : 15) << 4;
+    if (nLiterals >= 15) {
+        int rest = nLiterals - 15;
+        for (; rest >= 255; rest -= 255) dst[out++] = 255;
+        dst[out++] = rest;
+    }
+    memcpy(&dst[out], literals, nLiterals);
+    out += nLiterals;
+    if (match == 0) return out;
+
+    dst[out++] = offset & 0xff;
+    dst[out++] = offset >> 8;
+    *token |= extra < 15 ? extra : 15;
+    if (extra >= 15) {
+        int rest = extra - 15;
+        for (; rest >= 255; rest -= 255) dst[out++] = 255;
+        dst[out++] = rest;
+    }
+    return out;
+}
+
+/**
+* LZ Compress
+* * Greedy LZ77 in the LZ4 block layout. Every position's first four bytes are hashed to
+* * the last position that hashed the same, which is taken as a match if the bytes agree.
+* @param src the data
+* @param length its size
+* @param dst the output
+* @param capacity most bytes the output may take
+* @return the compressed size, 0 if it does not fit in the capacity
+*/
+static int lzCompress(const unsigned char *src, int length, unsigned char *dst, int capacity) {
+    int table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+    int anchor = 0;
+    int position = 0;
+    int out = 0;
+    while (position + LZ_MIN_MATCH <= length) {
+        uint32_t sequence = read32(&src[position]);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int candidate = table[hash] - 1;
+        table[hash] = position + 1;
+        if (candidate < 0 || position - candidate > LZ_MAX_OFFSET || read32(&src[candidate]) != sequence) {
+            position++;
+            continue;
+        }
+        int match = LZ_MIN_MATCH;
+        while (position + match < length && src[candidate + match] == src[position + match]) match++;
+        out = lzEmit(dst, out, capacity, &src[anchor], position - anchor, position - candidate, match);
+        if (out < 0) return 0;
+        position += match;
+        anchor = position;
+    }
+    out = lzEmit(dst, out, capacity, &src[anchor], length - anchor, 0, 0);
+    return out < 0 ? 0 : out;
+}
+
+/**
+* LZ Decompress
+* * Expands a block written by lzCompress
+* @param src the block
+* @param srcLength its size
+* @param dst the output, of the original size
+* @param length the original size
+* @return 0 on success, -1 if the block is corrupt
+*/
+static int lzDecompress(const unsigned char *src, int srcLength, unsigned char *dst, int length) {
+    int in = 0;
+    int out = 0;
+    while (in < srcLength) {
+        int token = src[in++];
+        int literals = token >> 4;
+        if (literals == 15) {
+            int byte;
+            do {
+                byte = src[in++];
+                literals += byte;
+            } while (byte == 255);
+        }
+        if (out + literals > length || in + literals > srcLength) return -1;
+        memcpy(&dst[out], &src[in], literals);
+        in += literals;
+        out += literals;
+        if (in >= srcLength) break;
+
+        int offset = src[in] | src[in + 1] << 8;
+        in += 2;
+        int match = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15) {
+            int byte;
+            do {
+                byte = src[in++];
+                match += byte;
+            } while (byte == 255);
+        }
+        if (offset == 0 || offset > out || out + match > length) return -1;
+        // Byte by byte, as a match may overlap the bytes it produces
+        for (int i = 0; i < match; i++) dst[out + i] = dst[out - offset + i];
+        out += match;
+    }
+    return out == length ? 0 : -1;
+}
+
+static inline int classSize(int sizeClass) {
+    return (sizeClass + 1) * CLASS_BYTES;
+}
+
+static inline char *objectAddress(int slab, int object) {
+    return tierArena + (size_t)slab * slabSize + (size_t)object * classSize(tierSlabs[slab].sizeClass);
+}
+
+/**
+* Unlink Slab
+* * Takes a slab out of the doubly linked list starting at 'head'
+*/
+static void unlinkSlab(int *head, int slab) {
+    if (tierSlabs[slab].prev == -1) {
+        *head = tierSlabs[slab].next;
+    } else {
+        tierSlabs[tierSlabs[slab].prev].next = tierSlabs[slab].next;
+    }
+    if (tierSlabs[slab].next != -1) tierSlabs[tierSlabs[slab].next].prev = tierSlabs[slab].prev;
+    tierSlabs[slab].prev = -1;
+    tierSlabs[slab].next = -1;
+}
+
+static void pushSlab(int *head, int slab) {
+    tierSlabs[slab].prev = -1;
+    tierSlabs[slab].next = *head;
+    if (*head != -1) tierSlabs[*head].prev = slab;
+    *head = slab;
+}
+
+/**
+* Slab Alloc
+* * Allocates an object of a size class from a slab with room, or from a free slab
+* @param sizeClass the size class
+* @param object set to the object within the slab
+* @return the slab, -1 if the pool is full
+*/
+static int slabAlloc(int sizeClass, int *object) {
+    int slab = classSlabs[sizeClass];
+    if (slab == -1) {
+        if (freeSlabs == -1) return -1;
+        slab = freeSlabs;
+        unlinkSlab(&freeSlabs, slab);
+        tierSlabs[slab].sizeClass = sizeClass;
+        tierSlabs[slab].used = 0;
+        tierSlabs[slab].carved = 0;
+        tierSlabs[slab].freeObject = -1;
+        pushSlab(&classSlabs[sizeClass], slab);
+        slabsUsed++;
+    }
+
+    Slab *entry = &tierSlabs[slab];
+    if (entry->freeObject != -1) {
+        *object = entry->freeObject;
+        memcpy(&entry->freeObject, objectAddress(slab, *object), sizeof(int));
+    } else {
+        *object = entry->carved++;
+    }
+    entry->used++;
+    // A full slab leaves its class's list until an object of it is freed
+    if (entry->freeObject == -1 && entry->carved == slabSize / classSize(sizeClass)) unlinkSlab(&classSlabs[sizeClass], slab);
+    return slab;
+}
+
+/**
+* Slab Free
+* * Frees an object, returning its slab to the free slabs once it is empty
+*/
+static void slabFree(int slab, int object) {
+    Slab *entry = &tierSlabs[slab];
+    int sizeClass = entry->sizeClass;
+    bool wasFull = entry->freeObject == -1 && entry->carved == slabSize / classSize(sizeClass);
+    memcpy(objectAddress(slab, object), &entry->freeObject, sizeof(int));
+    entry->freeObject = object;
+    entry->used--;
+    if (wasFull) pushSlab(&classSlabs[sizeClass], slab);
+    if (entry->used == 0) {
+        unlinkSlab(&classSlabs[sizeClass], slab);
+        entry->sizeClass = -1;
+        pushSlab(&freeSlabs, slab);
+        slabsUsed--;
+    }
+}
+
+/**
+* Expand
+* * Restores the contents of a page from its copy in the tier
+* @param page virtual page number, with a copy stored
+* @param data filled with the page's contents
+*/
+static void expand(int page, char *data) {
+    TierEntry *entry = &tierEntries[page];
+    if (entry->sameFilled) {
+        unsigned long *words = (unsigned long *)data;
+        for (int i = 0; i < tierPageSize / (int)sizeof(unsigned long); i++) words[i] = entry->fill;
+        return;
+    }
+    unsigned long long begin = __rdtsc();
+    if (lzDecompress((unsigned char *)objectAddress(entry->slab, entry->object), entry->length,
+                     (unsigned char *)data, tierPageSize) != 0) {
+        printf("Corrupt compressed page %d\n", page);
+        exit(-1);
+    }
+    tierDecompressCycles += __rdtsc() - begin;
+    tierDecompressions++;
+}
+
+/**
+* Write Back Oldest
+* * Moves the oldest compressed copy to the swap file to free pool memory
+* @return false if the tier holds no compressed copy
+*/
+static bool writeBackOldest(void) {
+    if (tierOldest == -1) return false;
+    int page = tierOldest;
+    expand(page, tierScratch);
+    swapQueueCopy(page, tierScratch);
+    tierDrop(page);
+    tierWriteBacks++;
+    return true;
+}
+
+/**
+* Main Functions
+*/
+
+int tierInit(int n_pages, int page_size, long max_bytes) {
+    tierPageSize = page_size;
+    slabSize = SLAB_PAGES * page_size;
+    // Copies over three quarters of a page save too little to be worth the pool memory
+    maxObject = page_size * 3 / 4;
+    nClasses = (maxObject + CLASS_BYTES - 1) / CLASS_BYTES;
+    nTierSlabs = max_bytes / slabSize;
+    if (nTierSlabs < 1) nTierSlabs = 1;
+
+    tierArena = malloc((size_t)nTierSlabs * slabSize);
+    tierSlabs = calloc(nTierSlabs, sizeof(Slab));
+    classSlabs = malloc(nClasses * sizeof(int));
+    tierEntries = calloc(n_pages, sizeof(TierEntry));
+    tierCompressed = malloc(page_size);
+    tierScratch = malloc(page_size);
+    if (tierArena == NULL || tierSlabs == NULL || classSlabs == NULL || tierEntries == NULL || tierCompressed == NULL || tierScratch == NULL) return -1;
+    for (int i = 0; i < nClasses; i++) classSlabs[i] = -1;
+    for (int i = nTierSlabs - 1; i >= 0; i--) {
+        tierSlabs[i].sizeClass = -1;
+        pushSlab(&freeSlabs, i);
+    }
+    return 0;
+}
+
+bool tierStore(int page, const char *data) {
+    if (tierEntries == NULL) return false;
+    tierDrop(page);
+    TierEntry *entry = &tierEntries[page];
+
+    // Same-filled pages, such as zeroed ones, only need their word
+    const unsigned long *words = (const unsigned long *)data;
+    int nWords = tierPageSize / sizeof(unsigned long);
+    int i = 1;
+    while (i < nWords && words[i] == words[0]) i++;
+    if (i == nWords) {
+        entry->stored = true;
+        entry->sameFilled = true;
+        entry->fill = words[0];
+        tierSameFilled++;
+        tierStores++;
+        return true;
+    }
+
+    unsigned long long begin = __rdtsc();
+    int length = lzCompress((const unsigned char *)data, tierPageSize, tierCompressed, maxObject);
+    tierCompressCycles += __rdtsc() - begin;
+    tierCompressions++;
+    if (length == 0) {
+        tierRejected++;
+        return false;
+    }
+
+    int sizeClass = (length + CLASS_BYTES - 1) / CLASS_BYTES - 1;
+    int slab, object;
+    while ((slab = slabAlloc(sizeClass, &object)) == -1) {
+        if (!writeBackOldest()) {
+            tierRejected++;
+            return false;
+        }
+    }
+    memcpy(objectAddress(slab, object), tierCompressed, length);
+    entry->stored = true;
+    entry->sameFilled = false;
+    entry->slab = slab;
+    entry->object = object;
+    entry->length = length;
+
+    // Newest last, so the pool gives up the copies stored longest ago first
+    entry->prev = tierNewest;
+    entry->next = -1;
+    if (tierNewest == -1) {
+        tierOldest = page;
+    } else {
+        tierEntries[tierNewest].next = page;
+    }
+    tierNewest = page;
+    tierPages++;
+    tierBytesStored += length;
+    tierStores++;
+    return true;
+}
+
+bool tierLoad(int page, char *data) {
+    if (tierEntries == NULL || !tierEntries[page].stored) return false;
+    expand(page, data);
+    tierHits++;
+    return true;
+}
+
+void tierDrop(int page) {
+    if (tierEntries == NULL || !tierEntries[page].stored) return;
+    TierEntry *entry = &tierEntries[page];
+    entry->stored = false;
+    if (entry->sameFilled) return;
+
+    slabFree(entry->slab, entry->object);
+    if (entry->prev == -1) {
+        tierOldest = entry->next;
+    } else {
+        tierEntries[entry->prev].next = entry->next;
+    }
+    if (entry->next == -1) {
+        tierNewest = entry->prev;
+    } else {
+        tierEntries[entry->next].prev = entry->prev;
+    }
+    tierPages--;
+    tierBytesStored -= entry->length;
+}
+
+void tierUsage(unsigned long *pages, unsigned long *bytes, unsigned long *slabBytes) {
+    *pages = tierPages;
+    *bytes = tierBytesStored;
+    *slabBytes = (unsigned long)slabsUsed * slabSize;
+}
@@ -0,0 +1,51 @@
+// 473_ztier.h
+// Description: Compressed in-memory tier between the frame pool and the swap file
+
+#ifndef _473_ZTIER_H
+#define _473_ZTIER_H
+
+#include <stdbool.h>
+
+// Counters of the tier, read by the pager's reporting functions
+//  tierStores - Pages stored, compressed or same filled
+//  tierSameFilled - Stored pages that were one repeated word, kept without pool memory
+//  tierRejected - Pages that compressed too poorly, or did not fit, and went to the swap file
+//  tierWriteBacks - Pages written to the swap file to make room in the pool
+//  tierHits - Pages loaded back from the tier
+//  tierCompressCycles, tierDecompressCycles - Time stamp counter cycles spent in the compressor
+//  tierCompressions, tierDecompressions - Calls to the compressor
+extern unsigned long tierStores;
+extern unsigned long tierSameFilled;
+extern unsigned long tierRejected;
+extern unsigned long tierWriteBacks;
+extern unsigned long tierHits;
+extern unsigned long long tierCompressCycles;
+extern unsigned long long tierDecompressCycles;
+extern unsigned long tierCompressions;
+extern unsigned long tierDecompressions;
+
+/* 'tierInit()' sets up a pool of at most 'max_bytes' bytes for the compressed copies of up
+ * to 'n_pages' pages of 'page_size' bytes. Returns 0 on success, -1 otherwise.
+ */
+extern int tierInit(int n_pages, int page_size, long max_bytes);
+
+/* 'tierStore()' keeps a copy of 'data' as the contents of virtual page 'page', writing the
+ * oldest copies to the swap file when the pool is full. Returns false if the page is left
+ * for the swap file, as it compresses poorly or cannot fit.
+ */
+extern bool tierStore(int page, const char *data);
+
+/* 'tierLoad()' fills 'data' with the copy of 'page' in the tier. The copy is kept, as it
+ * stays valid until the page is written. Returns false if the tier has no copy of it.
+ */
+extern bool tierLoad(int page, char *data);
+
+/* 'tierDrop()' forgets the copy of 'page', once a newer one goes to the swap file. */
+extern void tierDrop(int page);
+
+/* 'tierUsage()' sets 'pages' to the pages stored with pool memory, 'bytes' to their
+ * compressed size and 'slabBytes' to the pool memory holding them.
+ */
+extern void tierUsage(unsigned long *pages, unsigned long *bytes, unsigned long *slabBytes);
+
+#endif
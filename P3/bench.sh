@@ -0,0 +1,25 @@
+# Miss ratio curves: runs every policy on synthetic traces across a sweep of frame counts
+# Usage: ./bench.sh [<pages> [<ops>]]
+pages=${1:-512}
+ops=${2:-50000}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+for pattern in zipf loop phase
+do
+  ./gen $pattern $pages $ops > "$dir/$pattern"
+  echo "Pattern: $pattern  Pages: $pages  Ops: $ops"
+  printf "policy\tframes\tfaults\t\tmisses\t\tmiss-ratio\twrite-backs\n"
+  for alg in 1 2 3 4 5 6 7
+  do
+    for frames in $((pages / 16)) $((pages / 8)) $((pages / 4)) $((pages / 2)) $((pages * 3 / 4)) $pages
+    do
+      ./out -r -n $pages -f $frames $alg "$dir/$pattern" | awk -v alg=$alg -v frames=$frames -v ops=$ops '
+        /^faults:/ { faults = $2 }
+        /ReadNPP:/ { misses = $2 + $4 }
+        /^write backs:/ { writes = $3 }
+        END { printf "%d\t%d\t%d\t\t%d\t\t%.4f\t\t%d\n", alg, frames, faults, misses, misses / ops, writes }'
+    done
+  done
+  echo
+done
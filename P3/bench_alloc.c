@@ -0,0 +1,273 @@
+// bench_alloc.c
+// Description: Replays an allocation trace with references to the objects through the
+//              allocators of ../P2 on top of the pager, and reports the faults, footprint
+//              and working set of each allocator
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "473_mm.h"
+#include "my_memory.h"
+#include "trace.h"
+
+#define  ALLOCATORS  4
+#define  BUDDY       0
+#define  SLAB        1
+#define  SMALL_SLAB  2
+#define  CACHE       3
+// Objects per slab of the small slab allocator
+#define  SMALL_SLAB_OBJECTS  8
+
+// Outcome of one allocator, written by its child
+//  allocs, failures, frees, references - Ops replayed, failures are allocations not satisfied
+//  faults, misses - Faults of every type, and those on non-present pages
+//  evictions, writeBacks - As reported by the pager
+//  footprint - Pages that ever faulted in
+//  span - Pages up to the highest one that faulted in
+//  wsSum, wsPeak, windows - Pages referenced per window of ops, summed and largest
+//  done - Set once the child finished
+typedef struct {
+  unsigned long allocs, failures, frees, references;
+  unsigned long faults, misses, evictions, writeBacks;
+  int footprint, span;
+  unsigned long wsSum, wsPeak, windows;
+  int done;
+} AllocResult;
+
+// Object cache of one size, for the cache allocator
+typedef struct {
+  uint32_t size;
+  MyCache *cache;
+  char name[16];
+} SizeCache;
+
+static const char *allocatorNames[ALLOCATORS] = {"buddy", "slab", "slab-8", "cache"};
+static const TraceHeader *traceHeader;
+static const TraceOp *traceOps;
+static int pageSize;
+static int memSize = 1 << 22;
+static int frames;
+static int policy;
+static int window = 1000;
+
+static char *region;
+static int nPages;
+static char *faulted;
+static int *pageWindow;
+static int currentWindow = 1;
+static unsigned long windowPages;
+
+void mm_logger(int virt_page, int fault_type, int evicted_page, int write_back, unsigned int phy_addr)
+{
+  if (fault_type <= 1 && virt_page >= 0 && virt_page < nPages) faulted[virt_page] = 1;
+}
+
+void print_stats()
+{
+}
+
+static int loadTrace(const char *path)
+{
+  int file = open(path, O_RDONLY);
+  struct stat info;
+  if (file < 0 || fstat(file, &info) != 0 || info.st_size < (off_t)sizeof(TraceHeader)) {
+    printf("Invalid trace file: %s\n", path);
+    return -1;
+  }
+  void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (map == MAP_FAILED) return -1;
+  traceHeader = map;
+  traceOps = (const TraceOp *)(traceHeader + 1);
+  if (memcmp(traceHeader->magic, TRACE_MAGIC, 4) != 0 || traceHeader->version != TRACE_VERSION ||
+      sizeof(TraceHeader) + traceHeader->nOps * sizeof(TraceOp) > (uint64_t)info.st_size) {
+    printf("Invalid trace file: %s\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+// Counts the pages of [start, start + size) toward the working set of the current window
+static void reference(char *start, uint32_t size)
+{
+  int first = (start - region) / pageSize;
+  int last = (start + (size ? size - 1 : 0) - region) / pageSize;
+  for (int page = first; page <= last && page < nPages; page++) {
+    if (pageWindow[page] == currentWindow) continue;
+    pageWindow[page] = currentWindow;
+    windowPages++;
+  }
+}
+
+static void endWindow(AllocResult *result)
+{
+  result->wsSum += windowPages;
+  if (windowPages > result->wsPeak) result->wsPeak = windowPages;
+  result->windows++;
+  windowPages = 0;
+  currentWindow++;
+}
+
+// Allocates from the object cache of 'size' bytes, created on first use
+static void *cacheAlloc(SizeCache **caches, int *nCaches, uint32_t size, MyCache **used)
+{
+  int i = 0;
+  while (i < *nCaches && (*caches)[i].size != size) i++;
+  if (i == *nCaches) {
+    if ((*nCaches & (*nCaches - 1)) == 0) *caches = realloc(*caches, (*nCaches ? *nCaches * 2 : 1) * sizeof(SizeCache));
+    SizeCache *entry = &(*caches)[i];
+    entry->size = size;
+    snprintf(entry->name, sizeof(entry->name), "size-%u", size);
+    entry->cache = my_cache_create(entry->name, size, 0, NULL, NULL);
+    (*nCaches)++;
+  }
+  *used = (*caches)[i].cache;
+  return *used ? my_cache_alloc(*used) : NULL;
+}
+
+static void run(int allocator, AllocResult *result)
+{
+  region = mmap(NULL, memSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) exit(1);
+  nPages = memSize / pageSize;
+  faulted = calloc(nPages, 1);
+  pageWindow = calloc(nPages, sizeof(int));
+  uint32_t handles = traceHeader->nHandles;
+  char **objects = calloc(handles, sizeof(char *));
+  uint32_t *sizes = calloc(handles, sizeof(uint32_t));
+  MyCache **objectCaches = calloc(handles, sizeof(MyCache *));
+  SizeCache *caches = NULL;
+  int nCaches = 0;
+
+  mm_init(region, memSize, frames, pageSize, policy);
+  if (allocator == SMALL_SLAB) set_slab_objects(SMALL_SLAB_OBJECTS);
+  setup(allocator == BUDDY ? 0 : 1, memSize, region);
+
+  volatile char sink;
+  for (uint64_t i = 0; i < traceHeader->nOps; i++) {
+    const TraceOp *op = &traceOps[i];
+    uint32_t handle = op->handle;
+    if (handle >= handles) continue;
+    if (op->type == OP_ALLOC) {
+      if (objects[handle]) continue;
+      char *object;
+      if (allocator == CACHE) {
+        object = op->size ? cacheAlloc(&caches, &nCaches, op->size, &objectCaches[handle]) : NULL;
+      } else {
+        object = my_malloc(op->size);
+      }
+      result->allocs++;
+      if (object == NULL || object == (void *)-1) {
+        result->failures++;
+        continue;
+      }
+      // Objects are initialized when allocated
+      memset(object, 0, op->size);
+      reference(object, op->size);
+      objects[handle] = object;
+      sizes[handle] = op->size;
+    } else if (op->type == OP_FREE) {
+      if (objects[handle] == NULL) continue;
+      reference(objects[handle], 1);
+      if (allocator == CACHE) {
+        my_cache_free(objectCaches[handle], objects[handle]);
+      } else {
+        my_free(objects[handle]);
+      }
+      objects[handle] = NULL;
+      result->frees++;
+    } else if (op->type == OP_READ || op->type == OP_WRITE) {
+      if (objects[handle] == NULL || sizes[handle] == 0) continue;
+      char *byte = objects[handle] + op->size % sizes[handle];
+      if (op->type == OP_WRITE) {
+        *byte = (char)i;
+      } else {
+        sink = *byte;
+      }
+      reference(byte, 1);
+      result->references++;
+    }
+    if ((i + 1) % window == 0) endWindow(result);
+  }
+  if (windowPages) endWindow(result);
+  (void)sink;
+
+  result->faults = mm_report_npage_faults();
+  result->misses = mm_report_nfaults(0) + mm_report_nfaults(1);
+  result->evictions = mm_report_nevictions();
+  result->writeBacks = mm_report_nwrite_backs();
+  for (int page = 0; page < nPages; page++) {
+    if (!faulted[page]) continue;
+    result->footprint++;
+    result->span = page + 1;
+  }
+  result->done = 1;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "m:w:")) != -1) {
+    switch (opt) {
+      case 'm':
+        memSize = atoi(optarg);
+        break;
+      case 'w':
+        window = atoi(optarg);
+        break;
+      default:
+        return -1;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if (argc < 4) {
+    printf("Usage: ./alloc [-m <mem_size>] [-w <window>] <replacement_policy> <frames> <trace_file>\n");
+    return -1;
+  }
+  policy = atoi(argv[1]);
+  frames = atoi(argv[2]);
+  pageSize = sysconf(_SC_PAGE_SIZE);
+  if (policy < 1 || policy > 7 || frames < 1 || window < 1 || memSize < pageSize || memSize & (memSize - 1)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+  if (loadTrace(argv[3]) < 0) return -1;
+
+  AllocResult *results = mmap(NULL, sizeof(AllocResult) * ALLOCATORS, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (results == MAP_FAILED) return -1;
+  memset(results, 0, sizeof(AllocResult) * ALLOCATORS);
+
+  printf("Trace: %s  Ops: %lu  Pages: %d  Frames: %d  Window: %d ops\n", argv[3],
+      (unsigned long)traceHeader->nOps, memSize / pageSize, frames, window);
+  printf("allocator\tfaults\tmisses\tevictions\twrite-backs\tfootprint\tspan\tmean-ws\tpeak-ws\tfailures\n");
+  // The manager is set up once per process, so every allocator runs in a child
+  for (int a = 0; a < ALLOCATORS; a++) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+      run(a, &results[a]);
+      exit(0);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    AllocResult *result = &results[a];
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !result->done) {
+      printf("%s failed\n", allocatorNames[a]);
+      return -1;
+    }
+    printf("%s\t\t%lu\t%lu\t%lu\t\t%lu\t\t%d\t\t%d\t%.1f\t%lu\t%lu\n", allocatorNames[a], result->faults,
+        result->misses, result->evictions, result->writeBacks, result->footprint, result->span,
+        result->windows ? (double)result->wsSum / result->windows : 0.0, result->wsPeak, result->failures);
+  }
+  return 0;
+}
@@ -0,0 +1,163 @@
+// bench_tenants.c
+// Description: Runs several tenants, each a region of its own with its own access pattern,
+//              under every frame allocation mode and reports their faults
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "473_mm.h"
+
+#define  TENANTS  3
+#define  MODES    4
+
+// Work of one tenant
+//  name - Access pattern
+//  pages - Size of its region in pages
+//  hot - Pages its accesses mostly go to
+//  region - Its memory
+//  shadow - Last value written to the first int of every page
+//  seed - State of its random numbers
+typedef struct {
+  const char *name;
+  int pages;
+  int hot;
+  int *region;
+  int *shadow;
+  unsigned int seed;
+} Tenant;
+
+static const char *modeNames[MODES] = {"global", "equal", "pff", "ws"};
+static int pageSize;
+static int frames = 192;
+static int window = 64;
+static int opsPerTenant = 100000;
+static volatile int failed = 0;
+static pthread_barrier_t start;
+
+void mm_logger(int virt_page, int fault_type, int evicted_page, int write_back, unsigned int phy_addr)
+{
+}
+
+void print_stats()
+{
+}
+
+static int nextPage(Tenant *tenant, int op)
+{
+  if (strcmp(tenant->name, "scan") == 0) return op % tenant->pages;
+  // Nine accesses in ten go to the hot pages
+  if (rand_r(&tenant->seed) % 10) return rand_r(&tenant->seed) % tenant->hot;
+  return rand_r(&tenant->seed) % tenant->pages;
+}
+
+static void *work(void *arg)
+{
+  Tenant *tenant = arg;
+  int perPage = pageSize / sizeof(int);
+  pthread_barrier_wait(&start);
+  for (int op = 0; op < opsPerTenant && !failed; op++) {
+    int page = nextPage(tenant, op);
+    if (rand_r(&tenant->seed) % 3 == 0) {
+      int value = rand_r(&tenant->seed);
+      tenant->region[page * perPage] = value;
+      tenant->shadow[page] = value;
+    } else if (tenant->region[page * perPage] != tenant->shadow[page]) {
+      printf("%s read a stale value from page %d\n", tenant->name, page);
+      failed = 1;
+    }
+  }
+  return NULL;
+}
+
+static int run(int policy, int mode)
+{
+  // A tenant with a small hot set, one with a large one and one scanning more than fits
+  Tenant tenants[TENANTS] = {
+    {"small", 512, 32},
+    {"large", 512, 128},
+    {"scan", 256, 256}
+  };
+  for (int i = 0; i < TENANTS; i++) {
+    Tenant *tenant = &tenants[i];
+    if (posix_memalign((void *)&tenant->region, pageSize, (size_t)tenant->pages * pageSize)) return -1;
+    memset(tenant->region, 0, (size_t)tenant->pages * pageSize);
+    tenant->shadow = calloc(tenant->pages, sizeof(int));
+    tenant->seed = i + 1;
+    if (i > 0) mm_add_region(tenant->region, tenant->pages * pageSize);
+  }
+  mm_set_frame_allocation(mode, window);
+  mm_init(tenants[0].region, tenants[0].pages * pageSize, frames, pageSize, policy);
+
+  // Every tenant starts at once, so none runs alone with the frames of the others
+  pthread_t ids[TENANTS];
+  struct timespec begin, end;
+  pthread_barrier_init(&start, NULL, TENANTS + 1);
+  for (int i = 0; i < TENANTS; i++) pthread_create(&ids[i], NULL, work, &tenants[i]);
+  pthread_barrier_wait(&start);
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (int i = 0; i < TENANTS; i++) pthread_join(ids[i], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+  unsigned long total = 0;
+  printf("%s", modeNames[mode]);
+  for (int i = 0; i < TENANTS; i++) {
+    printf("\t%lu/%d/%lu", mm_report_region_faults(i), mm_report_region_frames(i), mm_report_region_throttles(i));
+    total += mm_report_region_faults(i);
+  }
+  printf("\t%lu\t\t%.3f\t\t%.4f\n", total, seconds, (double)total / (TENANTS * opsPerTenant));
+  fflush(stdout);
+  return failed ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "w:")) != -1) {
+    switch (opt) {
+      case 'w':
+        window = atoi(optarg);
+        break;
+      default:
+        return -1;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if (argc < 2) {
+    printf("Usage: ./tenants [-w <window>] <replacement_policy> [<frames> <ops_per_tenant>]\n");
+    return -1;
+  }
+  int policy = atoi(argv[1]);
+  if (argc > 3) {
+    frames = atoi(argv[2]);
+    opsPerTenant = atoi(argv[3]);
+  }
+  if (policy < 1 || policy > 7 || frames < TENANTS || window < 1) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+  pageSize = sysconf(_SC_PAGE_SIZE);
+
+  // The manager is set up once per process, so every mode runs in a child
+  printf("mode\tsmall\t\tlarge\t\tscan\t\tfaults\t\tseconds\t\tper access\n");
+  printf("\t(faults/frames/throttles)\n");
+  for (int mode = 0; mode < MODES; mode++) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) exit(run(policy, mode) == 0 ? 0 : 1);
+    int status;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("%s failed\n", modeNames[mode]);
+      return -1;
+    }
+  }
+  return 0;
+}
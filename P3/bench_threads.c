@@ -0,0 +1,189 @@
+// bench_threads.c
+// Description: Scales the number of threads faulting on one managed region from 1 to N,
+//              checking every value read back and reporting fault throughput
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "473_mm.h"
+
+#define  SHARED_PAGES  4
+
+// Work of one thread
+//  id - Thread number
+//  slice - First int of the thread's own pages
+//  shadow - Last value written to every int of the thread's pages
+//  seed - State of the thread's random numbers
+typedef struct {
+    int id;
+    int *slice;
+    int *shadow;
+    unsigned int seed;
+} Worker;
+
+static int pageSize;
+static int pagesPerThread = 0;
+static int framesPerThread = 16;
+static int opsPerThread = 200000;
+static int numaNodes = 0;
+static int placement = 0;
+static int migrateAfter = 0;
+static int *shared;
+static pthread_barrier_t start;
+static volatile int failed = 0;
+static unsigned long logged = 0;
+
+void mm_logger(int virt_page, int fault_type, int evicted_page, int write_back, unsigned int phy_addr)
+{
+  logged++;
+}
+
+void print_stats()
+{
+}
+
+static void *work(void *arg)
+{
+  Worker *worker = arg;
+  int perPage = pageSize / sizeof(int);
+  if (numaNodes > 0) mm_set_thread_node(worker->id % numaNodes);
+  pthread_barrier_wait(&start);
+  for (int op = 0; op < opsPerThread && !failed; op++) {
+    // A quarter of the pages take most of the accesses, and every thread reads the shared pages
+    int page = rand_r(&worker->seed) % 4 == 0 ? rand_r(&worker->seed) % pagesPerThread
+                                              : rand_r(&worker->seed) % (pagesPerThread / 4);
+    int index = page * perPage + rand_r(&worker->seed) % perPage;
+    if (op % 16 == 0) {
+      if (shared[(rand_r(&worker->seed) % SHARED_PAGES) * perPage] != 0) failed = 1;
+    } else if (rand_r(&worker->seed) % 2) {
+      int value = rand_r(&worker->seed);
+      worker->slice[index] = value;
+      worker->shadow[index] = value;
+    } else if (worker->slice[index] != worker->shadow[index]) {
+      printf("thread %d read a stale value from page %d\n", worker->id, page);
+      failed = 1;
+    }
+  }
+  return NULL;
+}
+
+static int run(int threads, int policy, int engine, const char *swapFile)
+{
+  int pages = SHARED_PAGES + threads * pagesPerThread;
+  int frames = threads * framesPerThread;
+  int *vm;
+  if (posix_memalign((void *)&vm, pageSize, (size_t)pages * pageSize)) return -1;
+  memset(vm, 0, (size_t)pages * pageSize);
+  if (engine) mm_set_userfaultfd();
+  if (swapFile != NULL) mm_set_swap_file(swapFile);
+  if (numaNodes > 0) {
+    // Every node gets the same frames, threads are bound to the nodes in turn
+    for (int i = 0; i < numaNodes; i++) mm_add_numa_node(frames / numaNodes + (i < frames % numaNodes), 100, 160);
+    mm_set_numa_policy(placement, migrateAfter);
+  }
+  mm_init(vm, pages * pageSize, frames, pageSize, policy);
+
+  int perPage = pageSize / sizeof(int);
+  shared = vm;
+  Worker *workers = calloc(threads, sizeof(Worker));
+  pthread_t *ids = calloc(threads, sizeof(pthread_t));
+  for (int i = 0; i < threads; i++) {
+    workers[i].id = i;
+    workers[i].slice = vm + (size_t)(SHARED_PAGES + i * pagesPerThread) * perPage;
+    workers[i].shadow = calloc((size_t)pagesPerThread * perPage, sizeof(int));
+    workers[i].seed = i + 1;
+  }
+
+  // Every thread starts at once, so none runs alone with the frames of the others
+  struct timespec begin, end;
+  pthread_barrier_init(&start, NULL, threads + 1);
+  for (int i = 0; i < threads; i++) pthread_create(&ids[i], NULL, work, &workers[i]);
+  pthread_barrier_wait(&start);
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (int i = 0; i < threads; i++) pthread_join(ids[i], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+  unsigned long faults = mm_report_npage_faults();
+  printf("%d\t%lu\t\t%.3f\t\t%.0f\t\t%.0f", threads, faults, seconds, faults / seconds,
+         (double)threads * opsPerThread / seconds);
+  if (numaNodes > 0) {
+    unsigned long remote = mm_report_nremote_accesses();
+    unsigned long accesses = remote + mm_report_nlocal_accesses();
+    printf("\t\t%.1f%%\t\t%lu", accesses ? 100.0 * remote / accesses : 0.0, mm_report_nmigrations());
+  }
+  printf("\n");
+  fflush(stdout);
+  return failed ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  int engine = 0;
+  const char *swapFile = NULL;
+  while ((opt = getopt(argc, argv, "us:N:IM:")) != -1) {
+    switch (opt) {
+      case 'u':
+        engine = 1;
+        break;
+      case 's':
+        swapFile = optarg;
+        break;
+      case 'N':
+        numaNodes = atoi(optarg);
+        break;
+      case 'I':
+        placement = 1;
+        break;
+      case 'M':
+        migrateAfter = atoi(optarg);
+        break;
+      default:
+        return -1;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if (argc < 3) {
+    printf("Usage: ./threads [-u] [-s <swap_file>] [-N <nodes>] [-I] [-M <faults>] <replacement_policy> <max_threads> [<pages_per_thread> <frames_per_thread> <ops_per_thread>]\n");
+    printf("  pages_per_thread defaults to 16 * frames_per_thread * max_threads, 16 frames per thread and 200000 ops per thread\n");
+    return -1;
+  }
+  int policy = atoi(argv[1]);
+  int maxThreads = atoi(argv[2]);
+  if (argc > 5) {
+    pagesPerThread = atoi(argv[3]);
+    framesPerThread = atoi(argv[4]);
+    opsPerThread = atoi(argv[5]);
+  }
+  // By default the hot quarter of a thread's pages is four times every frame of the largest
+  // run, so a thread the scheduler runs alone still faults about as often as beside the others
+  if (pagesPerThread == 0) pagesPerThread = 16 * framesPerThread * maxThreads;
+  if (policy < 1 || policy > 7 || maxThreads < 1 || pagesPerThread < 4 || framesPerThread < 1 || numaNodes < 0 || numaNodes > framesPerThread) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+  pageSize = sysconf(_SC_PAGE_SIZE);
+
+  // The manager is set up once per process, so every thread count runs in a child
+  printf("threads\tfaults\t\tseconds\t\tfaults/s\tops/s%s\n", numaNodes > 0 ? "\t\tremote\t\tmigrated" : "");
+  for (int threads = 1; threads <= maxThreads; threads++) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) exit(run(threads, policy, engine, swapFile) == 0 ? 0 : 1);
+    int status;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("%d threads failed\n", threads);
+      return -1;
+    }
+  }
+  return 0;
+}
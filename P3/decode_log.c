@@ -0,0 +1,58 @@
+// decode_log.c
+// Description: Prints a binary fault log written by ./out -b in the format of print_stats
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "473_mm.h"
+#include "473_log.h"
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2) {
+    printf("Usage: ./decode <log_file>\n");
+    return -1;
+  }
+  int file = open(argv[1], O_RDONLY);
+  struct stat info;
+  if (file < 0 || fstat(file, &info) != 0 || info.st_size < (off_t)sizeof(LogHeader)) {
+    printf("Invalid log file: %s\n", argv[1]);
+    return -1;
+  }
+  char *log = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (log == MAP_FAILED) {
+    printf("Invalid log file: %s\n", argv[1]);
+    return -1;
+  }
+
+  LogHeader *header = (LogHeader *)log;
+  if (header->magic != LOG_MAGIC || header->recordSize != sizeof(struct MM_stats) || header->slots == 0 ||
+      (uint64_t)info.st_size != sizeof(LogHeader) + header->slots * (sizeof(struct MM_stats) + sizeof(uint64_t))) {
+    printf("Invalid log file: %s\n", argv[1]);
+    return -1;
+  }
+  struct MM_stats *records = (struct MM_stats *)(log + sizeof(LogHeader));
+  uint64_t *stamps = (uint64_t *)(log + sizeof(LogHeader) + header->slots * sizeof(struct MM_stats));
+
+  // Same output as print_stats, built in a buffer since logs may hold millions of faults
+  setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+  uint64_t i = 0;
+  if (header->count > header->slots) {
+    i = header->count - header->slots;
+    printf("(%lu earlier faults not kept)\n", (unsigned long)i);
+  }
+  printf("type\tvirt-page\tevicted-virt-page\twrite-back\tphy-addr\n");
+  for (; i < header->count; i++) {
+    struct MM_stats *entry = &records[i % header->slots];
+    if (stamps[i % header->slots] != i + 1) continue;
+    printf("%d\t\t%d\t\t%d\t\t%d\t\t0x%04x\n",
+        entry->fault_type, entry->virt_page, entry->evicted_page,
+        entry->write_back, entry->phy_addr);
+  }
+  munmap(log, info.st_size);
+  return 0;
+}
@@ -0,0 +1,208 @@
+// gen_trace.c
+// Description: Writes synthetic traces in the input file format of project3.c, with Zipf,
+//              looping scan and phase change access patterns, and allocation traces with
+//              references to the objects in the binary format of ../P2/trace.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "trace.h"
+
+#define  PHASES  4
+// Ints written at the start of a page, few enough for any page size
+#define  OFFSETS  64
+// Object sizes of heap traces, small ones most common
+#define  SIZES  8
+static const int heapSizes[SIZES] = {16, 24, 32, 48, 64, 128, 512, 2000};
+static const int sizeWeights[SIZES] = {20, 20, 15, 15, 10, 10, 6, 4};
+
+static int pages;
+static long ops;
+static int writePercent = 30;
+static double alpha = 1.0;
+static unsigned int seed = 1;
+
+static void emit(int page)
+{
+  int offset = rand_r(&seed) % OFFSETS;
+  if (rand_r(&seed) % 100 < writePercent) {
+    printf("write %d %d %d\n", page, offset, rand_r(&seed) % 1000);
+  } else {
+    printf("read %d %d 0\n", page, offset);
+  }
+}
+
+/**
+* Zipf
+* * Page of rank r is referenced with probability proportional to 1 / r^alpha. Ranks are
+* * shuffled over the pages, so hot pages are not neighbours.
+*/
+static void zipf()
+{
+  double *cdf = malloc(pages * sizeof(double));
+  int *rankPage = malloc(pages * sizeof(int));
+  double sum = 0;
+  for (int i = 0; i < pages; i++) {
+    sum += 1.0 / pow(i + 1, alpha);
+    cdf[i] = sum;
+    rankPage[i] = i;
+  }
+  for (int i = pages - 1; i > 0; i--) {
+    int j = rand_r(&seed) % (i + 1);
+    int page = rankPage[i];
+    rankPage[i] = rankPage[j];
+    rankPage[j] = page;
+  }
+  for (long op = 0; op < ops; op++) {
+    double target = (double)rand_r(&seed) / RAND_MAX * sum;
+    int low = 0, high = pages - 1;
+    while (low < high) {
+      int middle = (low + high) / 2;
+      if (cdf[middle] < target) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    emit(rankPage[low]);
+  }
+  free(cdf);
+  free(rankPage);
+}
+
+// Scans every page in order, over and over
+static void loop()
+{
+  for (long op = 0; op < ops; op++) emit(op % pages);
+}
+
+/**
+* Phase
+* * Splits the trace into PHASES phases, each referencing a working set of a quarter of
+* * the pages at random. Each phase's working set starts where the last one ended.
+*/
+static void phase()
+{
+  int workingSet = pages / PHASES > 0 ? pages / PHASES : 1;
+  for (long op = 0; op < ops; op++) {
+    int current = op * PHASES / ops;
+    emit((current * workingSet + rand_r(&seed) % workingSet) % pages);
+  }
+}
+
+static void emitOp(uint32_t handle, uint32_t size, int type)
+{
+  TraceOp op = {handle, size, type};
+  fwrite(&op, sizeof(op), 1, stdout);
+}
+
+/**
+* Heap
+* * Keeps up to 'pages' live objects, one per handle, of sizes drawn from heapSizes. One op in
+* * four allocates an object while there is room, one in eight frees a random one, and the
+* * others read or write a random offset of a live object. Objects referenced are Zipf
+* * distributed over their position in the live list, which a free fills with the last one.
+*/
+static void heap()
+{
+  uint32_t *live = malloc(pages * sizeof(uint32_t));
+  uint32_t *sizes = malloc(pages * sizeof(uint32_t));
+  uint32_t *unused = malloc(pages * sizeof(uint32_t));
+  double *cdf = malloc(pages * sizeof(double));
+  double sum = 0;
+  for (int i = 0; i < pages; i++) {
+    sum += 1.0 / pow(i + 1, alpha);
+    cdf[i] = sum;
+    unused[i] = pages - 1 - i;
+  }
+  int nLive = 0, nUnused = pages, weights = 0;
+  for (int i = 0; i < SIZES; i++) weights += sizeWeights[i];
+
+  TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, ops, pages, 0};
+  fwrite(&header, sizeof(header), 1, stdout);
+  for (long op = 0; op < ops; op++) {
+    int choice = rand_r(&seed) % 8;
+    if (nLive == 0 || (choice < 2 && nUnused > 0)) {
+      int pick = rand_r(&seed) % weights, i = 0;
+      while (pick >= sizeWeights[i]) pick -= sizeWeights[i++];
+      uint32_t handle = unused[--nUnused];
+      sizes[handle] = heapSizes[i];
+      live[nLive++] = handle;
+      emitOp(handle, sizes[handle], OP_ALLOC);
+    } else if (choice == 2) {
+      int index = rand_r(&seed) % nLive;
+      uint32_t handle = live[index];
+      live[index] = live[--nLive];
+      unused[nUnused++] = handle;
+      emitOp(handle, 0, OP_FREE);
+    } else {
+      double target = (double)rand_r(&seed) / RAND_MAX * cdf[nLive - 1];
+      int low = 0, high = nLive - 1;
+      while (low < high) {
+        int middle = (low + high) / 2;
+        if (cdf[middle] < target) {
+          low = middle + 1;
+        } else {
+          high = middle;
+        }
+      }
+      uint32_t handle = live[low];
+      int type = rand_r(&seed) % 100 < writePercent ? OP_WRITE : OP_READ;
+      emitOp(handle, rand_r(&seed) % sizes[handle], type);
+    }
+  }
+  free(live);
+  free(sizes);
+  free(unused);
+  free(cdf);
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "s:w:a:")) != -1) {
+    switch (opt) {
+      case 's':
+        seed = atoi(optarg);
+        break;
+      case 'w':
+        writePercent = atoi(optarg);
+        break;
+      case 'a':
+        alpha = atof(optarg);
+        break;
+      default:
+        return -1;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if (argc < 4) {
+    printf("Usage: ./gen [-s <seed>] [-w <write_percent>] [-a <zipf_alpha>] <zipf|loop|phase> <pages> <ops>\n");
+    printf("       ./gen [-s <seed>] [-w <write_percent>] [-a <zipf_alpha>] heap <objects> <ops>\n");
+    return -1;
+  }
+  pages = atoi(argv[2]);
+  ops = atol(argv[3]);
+  if (pages < 1 || ops < 1 || writePercent < 0 || writePercent > 100 || alpha <= 0) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+
+  if (strcmp(argv[1], "zipf") == 0) {
+    zipf();
+  } else if (strcmp(argv[1], "loop") == 0) {
+    loop();
+  } else if (strcmp(argv[1], "phase") == 0) {
+    phase();
+  } else if (strcmp(argv[1], "heap") == 0) {
+    heap();
+  } else {
+    printf("Unknown pattern: %s\n", argv[1]);
+    return -1;
+  }
+  return 0;
+}
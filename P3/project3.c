@@ -8,13 +8,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "473_mm.h"
+#include "473_log.h"
 
 const int MAX_OPS = 1000;
 
-FILE *fd;
+// Ring of the last LOG_SLOTS faults, MAX_OPS unless set with -L. stamps[slot] is the number
+// of the fault whose record the slot holds plus one, written once the record is complete.
+static unsigned long LOG_SLOTS;
+struct MM_stats *stats;
+uint64_t *stamps;
+// Faults logged, claimed by mm_logger with an atomic add
+static unsigned long statCounter = 0;
+
+// The trace is mapped whole and read in place, so it can be of any length
+char *trace;
+char *cursor;
+char *traceEnd;
+size_t traceSize;
 static int PAGE_SIZE;
 static int NUM_FRAMES = 4;
+static int NUM_PAGES = 16;
 
 char operation[10];
 int pageNumber;
@@ -23,30 +40,68 @@ int result;
 
 int open_file(char *filename)
 {
-  char mode = 'r';
-  fd = fopen(filename, &mode);
-  if (fd == NULL) {
+  int file = open(filename, O_RDONLY);
+  struct stat info;
+  if (file < 0 || fstat(file, &info) != 0) {
     printf("Invalid input file specified: %s\n", filename);
     return -1;
   }
-  else {
-    return 0;
+  traceSize = info.st_size;
+  trace = NULL;
+  if (traceSize > 0) {
+    trace = mmap(NULL, traceSize, PROT_READ, MAP_PRIVATE, file, 0);
+    if (trace == MAP_FAILED) {
+      printf("Invalid input file specified: %s\n", filename);
+      close(file);
+      return -1;
+    }
+    madvise(trace, traceSize, MADV_SEQUENTIAL);
   }
+  close(file);
+  cursor = trace;
+  traceEnd = trace + traceSize;
+  return 0;
 }
 
 void close_file()
 {
-  fclose(fd);
+  if (trace != NULL) munmap(trace, traceSize);
+}
+
+// Reads the next space delimited number of a line as atoi would, 0 if the line has no more fields
+int read_field(char **field, char *end, int *value)
+{
+  char *at = *field;
+  while (at < end && *at == ' ') at++;
+  if (at == end) {
+    return 0;
+  }
+  int sign = 1;
+  if (*at == '-') {
+    sign = -1;
+    at++;
+  }
+  int number = 0;
+  while (at < end && *at >= '0' && *at <= '9') {
+    number = number * 10 + (*at++ - '0');
+  }
+  while (at < end && *at != ' ') at++;
+  *value = sign * number;
+  *field = at;
+  return 1;
 }
 
 int read_next_ops()
 {
-  char line[1024];
-  if(!fgets(line, 1024, fd)) {
+  if (cursor >= traceEnd) {
     return 0;
   }
-  char *token;
-  char *rest=line;
+  char *line = cursor;
+  char *end = memchr(line, '\n', traceEnd - line);
+  if (end == NULL) {
+    end = traceEnd;
+  }
+  cursor = end + 1;
   /*
    * Format for input file (space delimited): <operation> <virt_page> <start_Offset> <result>
    * operation:     read / write
@@ -54,96 +109,277 @@ int read_next_ops()
    * start_offset:  Starting offset within the page being referenced
    * result:        Value being written (0 in case of read operation)
    */
-  if(token=strtok_r(rest, " ", &rest)) {
-    strcpy(operation, token);
-  } else {
-    return 0;
-  }
-  if(token=strtok_r(rest, " ", &rest)) {
-    pageNumber = atoi(token);
-  } else {
-    return 0;
-  }
-  if(token=strtok_r(rest, " ", &rest)) {
-    startOffset = atoi(token);
-  } else {
+  while (line < end && *line == ' ') line++;
+  int length = 0;
+  while (line + length < end && line[length] != ' ') length++;
+  if (length == 0 || length >= sizeof(operation)) {
     return 0;
   }
-  if(token=strtok_r(rest, " ", &rest)) {
-    result = atoi(token);
-  } else {
+  memcpy(operation, line, length);
+  operation[length] = '\0';
+  line += length;
+  if (!read_field(&line, end, &pageNumber) || !read_field(&line, end, &startOffset) || !read_field(&line, end, &result)) {
     return 0;
   }
   return 1;
 }
 
+// Every call claims the next fault number with one atomic add, so faults logged by several
+// threads at once, or by a signal handler interrupting another call, never share a slot.
+// Nothing is allocated or locked, which keeps it safe to call from a signal handler.
 void mm_logger(int virt_page, int fault_type, int evicted_page, int write_back, unsigned int phy_addr)
 {
-  stats[statCounter].virt_page     = virt_page;
-  stats[statCounter].fault_type    = fault_type;
-  stats[statCounter].evicted_page  = evicted_page;
-  stats[statCounter].write_back    = write_back;
-  stats[statCounter].phy_addr      = phy_addr;
-  statCounter++;
+  unsigned long fault = __atomic_fetch_add(&statCounter, 1, __ATOMIC_RELAXED);
+  struct MM_stats *entry = &stats[fault % LOG_SLOTS];
+  entry->virt_page     = virt_page;
+  entry->fault_type    = fault_type;
+  entry->evicted_page  = evicted_page;
+  entry->write_back    = write_back;
+  entry->phy_addr      = phy_addr;
+  __atomic_store_n(&stamps[fault % LOG_SLOTS], fault + 1, __ATOMIC_RELEASE);
 }
 
 void print_stats()
 {
-  int i=0;
+  unsigned long count = __atomic_load_n(&statCounter, __ATOMIC_ACQUIRE);
+  unsigned long i = 0;
+  if (count > LOG_SLOTS) {
+    i = count - LOG_SLOTS;
+    printf("(%lu earlier faults not kept)\n", i);
+  }
   printf("type\tvirt-page\tevicted-virt-page\twrite-back\tphy-addr\n");
-  for (i = 0; i < statCounter; i++) {
+  for (; i < count; i++) {
+    struct MM_stats *entry = &stats[i % LOG_SLOTS];
+    // A slot is only reused once LOG_SLOTS more faults are logged
+    if (__atomic_load_n(&stamps[i % LOG_SLOTS], __ATOMIC_ACQUIRE) != i + 1) continue;
     printf("%d\t\t%d\t\t%d\t\t%d\t\t0x%04x\n",\
-        stats[i].fault_type, stats[i].virt_page, stats[i].evicted_page,\
-        stats[i].write_back, stats[i].phy_addr);
+        entry->fault_type, entry->virt_page, entry->evicted_page,\
+        entry->write_back, entry->phy_addr);
+  }
+}
+
+// Writes the ring and its stamps as they are in memory, for decode_log to print later
+int dump_stats(const char *path)
+{
+  LogHeader header = {LOG_MAGIC, sizeof(struct MM_stats), LOG_SLOTS, __atomic_load_n(&statCounter, __ATOMIC_ACQUIRE)};
+  int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (file < 0) {
+    return -1;
   }
+  size_t records = LOG_SLOTS * sizeof(struct MM_stats);
+  size_t stampBytes = LOG_SLOTS * sizeof(uint64_t);
+  int failed = write(file, &header, sizeof(header)) != sizeof(header) ||
+               write(file, stats, records) != (ssize_t)records ||
+               write(file, stamps, stampBytes) != (ssize_t)stampBytes;
+  close(file);
+  return failed ? -1 : 0;
 }
 
 int main(int argc, char *argv[])
 {
+  int opt;
+  int low, high, interval = 10;
+  int report = 0;
+  int huge_size = 0;
+  const char *dump_path = NULL;
+  long log_slots = MAX_OPS;
+  int numa_nodes = 0, local_ns = 100, remote_ns = 160;
+  int placement = 0, migrate_after = 0;
+  int read_us, write_us;
+  while ((opt = getopt(argc, argv, "s:c:p:rui:H:n:f:g:z:Zb:L:N:IM:w:B:")) != -1) {
+    switch (opt) {
+      case 's':
+        mm_set_swap_file(optarg);
+        break;
+      case 'c':
+        if (sscanf(optarg, "%d:%d:%d", &low, &high, &interval) < 2) {
+          printf("Cleaner watermarks must be <low>:<high>[:<interval_ms>]\n");
+          return -1;
+        }
+        mm_set_cleaner(low, high, interval);
+        break;
+      case 'p':
+        mm_set_prefetch(atoi(optarg));
+        break;
+      case 'r':
+        report = 1;
+        break;
+      case 'u':
+        mm_set_userfaultfd();
+        break;
+      case 'i':
+        mm_set_sweep_interval(atoi(optarg));
+        break;
+      case 'n':
+        NUM_PAGES = atoi(optarg);
+        break;
+      case 'f':
+        NUM_FRAMES = atoi(optarg);
+        break;
+      case 'g':
+        PAGE_SIZE = atoi(optarg);
+        break;
+      case 'z':
+        mm_set_compressed_tier(atoi(optarg));
+        break;
+      case 'Z':
+        mm_set_zero_page();
+        break;
+      case 'b':
+        dump_path = optarg;
+        break;
+      case 'L':
+        log_slots = atol(optarg);
+        break;
+      case 'H':
+        huge_size = atoi(optarg);
+        mm_set_huge_pages(huge_size);
+        break;
+      case 'N':
+        if (sscanf(optarg, "%d:%d:%d", &numa_nodes, &local_ns, &remote_ns) != 1 &&
+            sscanf(optarg, "%d:%d:%d", &numa_nodes, &local_ns, &remote_ns) != 3) {
+          printf("NUMA nodes must be <nodes>[:<local_ns>:<remote_ns>]\n");
+          return -1;
+        }
+        break;
+      case 'I':
+        placement = 1;
+        break;
+      case 'M':
+        migrate_after = atoi(optarg);
+        break;
+      case 'w':
+        if (sscanf(optarg, "%d:%d", &read_us, &write_us) != 2) {
+          printf("I/O costs must be <read_us>:<write_us>\n");
+          return -1;
+        }
+        mm_set_io_cost(read_us, write_us);
+        break;
+      case 'B':
+        mm_set_write_budget(atoi(optarg));
+        break;
+      default:
+        return -1;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
   if (argc < 3) {
-    printf ("Not enough parameters provided.  Usage: ./out <replacement_policy> <input_file>\n");
+    printf ("Not enough parameters provided.  Usage: ./out [-s <swap_file>] [-c <low>:<high>[:<interval_ms>]] [-p <max_window>] [-r] [-u] [-i <faults>] [-H <huge_page_size>] [-z <tier_kb>] [-Z] [-b <log_file>] [-L <log_records>] [-N <nodes>[:<local_ns>:<remote_ns>]] [-I] [-M <faults>] [-w <read_us>:<write_us>] [-B <write_backs>] [-n <pages>] [-f <frames>] [-g <page_size>] <replacement_policy> <input_file>\n");
     printf ("  page replacement policy: 1 - FIFO\n");
     printf ("  page replacement policy: 2 - Third Chance\n");
+    printf ("  page replacement policy: 3 - Aging LRU\n");
+    printf ("  page replacement policy: 4 - WSClock\n");
+    printf ("  page replacement policy: 5 - ARC\n");
+    printf ("  page replacement policy: 6 - 2Q\n");
+    printf ("  page replacement policy: 7 - Cost-Aware\n");
+    printf ("  -s <swap_file>: back evicted pages with a swap file\n");
+    printf ("  -c <low>:<high>[:<interval_ms>]: clean dirty pages in the background between these percentages of frames\n");
+    printf ("  -p <max_window>: read up to this many pages ahead of sequential and strided faults\n");
+    printf ("  -r: print fault counts, eviction and write back rates and fault latencies after the log\n");
+    printf ("  -u: take faults through userfaultfd on a fault thread instead of SIGSEGV\n");
+    printf ("  -i <faults>: sample reference bits every this many faults, protecting pages in batches\n");
+    printf ("  -H <huge_page_size>: promote aligned ranges of this many bytes to huge pages once all their pages are hot\n");
+    printf ("  -z <tier_kb>: compress dirty evicted pages into a pool of this many KiB before the swap file\n");
+    printf ("  -Z: map pages read before they are written to a shared zero frame\n");
+    printf ("  -b <log_file>: write the fault log to this file in binary, to be printed with ./decode\n");
+    printf ("  -L <log_records>: keep the last this many faults in the log (%d by default)\n", MAX_OPS);
+    printf ("  -N <nodes>[:<local_ns>:<remote_ns>]: split the frames between this many memory nodes, accesses costing 100 ns locally and 160 ns remotely by default\n");
+    printf ("  -I: interleave pages over the nodes instead of placing them on the node of the thread touching them first\n");
+    printf ("  -M <faults>: migrate a page to the node of the thread faulting on it this many times in a row from another node\n");
+    printf ("  -w <read_us>:<write_us>: modeled cost of reading a page in and of writing a dirty page back, 100:300 by default\n");
+    printf ("  -B <write_backs>: write back at most this many pages per second, faults past it wait\n");
+    printf ("  -n <pages>: size of the virtual memory in pages (16 by default)\n");
+    printf ("  -f <frames>: number of physical frames (4 by default)\n");
+    printf ("  -g <page_size>: page size in bytes, a multiple of the system page size (the system page size by default)\n");
     return -1;
   }
   if (open_file(argv[2]) < 0) {
     return -1;
   }
   int policy = (atoi(argv[1]));
-  if(policy != 1 && policy != 2) {
+  if(policy < 1 || policy > 7) {
     printf("Unknown replacement policy specified\n");
     return -1;
   }
 
-  // Init setup
-  stats = (struct MM_stats *)malloc(sizeof(struct MM_stats) * MAX_OPS);
+  // Init setup, the log is mapped and populated up front so logging never allocates
+  if (log_slots < 1) {
+    printf("Invalid number of log records\n");
+    return -1;
+  }
+  LOG_SLOTS = log_slots;
+  stats = mmap(NULL, LOG_SLOTS * sizeof(struct MM_stats), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  stamps = mmap(NULL, LOG_SLOTS * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (stats == MAP_FAILED || stamps == MAP_FAILED) {
+    printf("Cannot allocate the fault log\n");
+    return -1;
+  }
   int *vm_ptr;
-  PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+  int system_page_size = sysconf(_SC_PAGE_SIZE);
+  if (PAGE_SIZE == 0) {
+    PAGE_SIZE = system_page_size;
+  }
+  // Pages are protected with mprotect, so they must cover whole system pages
+  if (PAGE_SIZE < system_page_size || PAGE_SIZE % system_page_size != 0) {
+    printf("Page size must be a multiple of %d\n", system_page_size);
+    return -1;
+  }
+  if (NUM_PAGES < 1 || NUM_FRAMES < 1 || (long)NUM_PAGES * PAGE_SIZE > 0x7fffffff) {
+    printf("Invalid virtual memory size or number of frames\n");
+    return -1;
+  }
   printf("Page Size: %d\n", PAGE_SIZE);
-  int vm_size = 16 * PAGE_SIZE;
-  if(posix_memalign((void*)&vm_ptr, PAGE_SIZE, vm_size)) {  
+  int vm_size = NUM_PAGES * PAGE_SIZE;
+  // Align the region to the huge page size so that every range of it can be promoted
+  if(posix_memalign((void*)&vm_ptr, huge_size > PAGE_SIZE ? huge_size : PAGE_SIZE, vm_size)) {  
     printf("posix_memalign failed\n");	
     return 0;
   }
   printf("Num Frames: %d\n", NUM_FRAMES);
+  if (numa_nodes > 0) {
+    if (numa_nodes > NUM_FRAMES) {
+      printf("Invalid number of NUMA nodes\n");
+      return -1;
+    }
+    // The frames are split evenly, the first nodes taking one more of any remainder
+    for (int i = 0; i < numa_nodes; i++) {
+      mm_add_numa_node(NUM_FRAMES / numa_nodes + (i < NUM_FRAMES % numa_nodes), local_ns, remote_ns);
+    }
+    mm_set_numa_policy(placement, migrate_after);
+  }
   mm_init((void*)vm_ptr, vm_size, NUM_FRAMES, PAGE_SIZE, policy);
 
   // Do Read/Write Operations
   while(read_next_ops()){
+    if (pageNumber < 0 || pageNumber >= NUM_PAGES) {
+      printf("Page %d is outside the virtual memory\n", pageNumber);
+      return 0;
+    }
+    size_t index = startOffset + (size_t)pageNumber * PAGE_SIZE / sizeof(int);
     if(strcmp(operation,"read") == 0){
-      int temp = vm_ptr[startOffset + ((int)((pageNumber*PAGE_SIZE)/sizeof(int)))];	
+      volatile int temp = vm_ptr[index];
     } else if(strcmp(operation,"write")==0){
-      vm_ptr[startOffset + ((int)((pageNumber*PAGE_SIZE)/sizeof(int)))] = result;	
+      vm_ptr[index] = result;
     } else{
       printf("Incorrect input file content\n");
       return 0;
     }
   } 
 
-  print_stats();
+  if (dump_path == NULL) {
+    print_stats();
+  } else if (dump_stats(dump_path) != 0) {
+    printf("Cannot write the fault log to %s\n", dump_path);
+  }
+  if (report) {
+    mm_print_report();
+  }
 
   // Cleanup
-  free(stats);
+  munmap(stats, LOG_SLOTS * sizeof(struct MM_stats));
+  munmap(stamps, LOG_SLOTS * sizeof(uint64_t));
   close_file();
   free(vm_ptr);
   return 0;
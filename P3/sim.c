@@ -0,0 +1,540 @@
+// sim.c
+// Description: Offline page replacement simulator. Replays project3.c traces through the
+//              policies of 473_policy.c with protections kept in the page table instead of
+//              mprotect, against Belady's OPT and LRU stack distance miss ratio curves
+
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "473_policy.h"
+
+#define  NPOLICIES  7
+#define  MAX_ACCESS  64
+
+/**
+* Data Structures
+*/
+
+// Fault type, as passed to mm_logger
+typedef enum {
+    ReadNPP = 0,
+    WriteNPP = 1,
+    WriteRO = 2,
+    ReadRW = 3,
+    WriteRW = 4
+} simFaultType;
+
+// Trace loaded in memory
+//  pages - Virtual page of every access
+//  offsets - Int offset within the page of every access
+//  writes - Nonzero for every write access
+//  length - Number of accesses
+//  nPages - One more than the highest page referenced
+typedef struct {
+    int *pages;
+    int *offsets;
+    char *writes;
+    long length;
+    int nPages;
+} Trace;
+
+// Result of one run
+//  faults - Faults of each type
+//  misses - Accesses to non-present pages
+//  writeBacks - Dirty pages evicted
+//  protections - Pages the policy protected to sample references
+typedef struct {
+    unsigned long faults[5];
+    unsigned long misses;
+    unsigned long writeBacks;
+    unsigned long protections;
+} SimResult;
+
+/**
+* Global Variables
+*/
+Trace trace;
+int pageSize = 4096;
+bool logFaults = false;
+int readCost = DEFAULT_READ_US;
+int writeCost = DEFAULT_WRITE_US;
+
+Page *pageTable;
+Frame *frameTable;
+MMContext mmContext;
+const MMPolicy *mmPolicyOps;
+int activePages;
+SimResult result;
+
+// Addresses of the last two faults, and the pages the policies that track references keep
+// accessible, as the pager keeps them for every thread
+long lastAddr;
+long prevAddr;
+Page *tracked[2];
+
+/**
+* Helper Functions
+*/
+
+/**
+* Load Trace
+* * Parses a trace in the input file format of project3.c, stopping at the first line that
+* * is not a read or a write with three numbers, as project3.c does
+* @param path the trace file
+* @return 0 on success, -1 if the file cannot be read
+*/
+static int loadTrace(const char *path) {
+    int file = open(path, O_RDONLY);
+    struct stat info;
+    if (file < 0 || fstat(file, &info) != 0) return -1;
+    char *text = info.st_size > 0 ? mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0) : NULL;
+    close(file);
+    if (text == MAP_FAILED) return -1;
+
+    long capacity = 1024;
+    trace.pages = malloc(capacity * sizeof(int));
+    trace.offsets = malloc(capacity * sizeof(int));
+    trace.writes = malloc(capacity);
+    if (trace.pages == NULL || trace.offsets == NULL || trace.writes == NULL) exit(-1);
+
+    char *line = text;
+    char *end = text + info.st_size;
+    while (line < end) {
+        char *next = memchr(line, '\n', end - line);
+        if (next == NULL) next = end;
+        char operation[10];
+        int page, offset, value;
+        int length = next - line < 1023 ? next - line : 1023;
+        char copy[1024];
+        memcpy(copy, line, length);
+        copy[length] = '\0';
+        if (sscanf(copy, "%9s %d %d %d", operation, &page, &offset, &value) != 4) break;
+        if (strcmp(operation, "read") != 0 && strcmp(operation, "write") != 0) break;
+        if (page < 0) break;
+
+        if (trace.length == capacity) {
+            capacity *= 2;
+            trace.pages = realloc(trace.pages, capacity * sizeof(int));
+            trace.offsets = realloc(trace.offsets, capacity * sizeof(int));
+            trace.writes = realloc(trace.writes, capacity);
+            if (trace.pages == NULL || trace.offsets == NULL || trace.writes == NULL) exit(-1);
+        }
+        trace.pages[trace.length] = page;
+        trace.offsets[trace.length] = offset;
+        trace.writes[trace.length] = operation[0] == 'w';
+        trace.length++;
+        if (page >= trace.nPages) trace.nPages = page + 1;
+        line = next + 1;
+    }
+    if (text != NULL) munmap(text, info.st_size);
+    return 0;
+}
+
+/**
+* Grant
+* * Gives a page the access the pager's setProtection would map it with
+* @param page the page table entry
+* @param write true for read and write access, false for read only
+*/
+static void grant(Page *page, bool write) {
+    pteSet(page, PTE_MAPPED);
+    if (write) {
+        pteSet(page, PTE_WRITABLE);
+    } else {
+        pteClear(page, PTE_WRITABLE);
+    }
+}
+
+/**
+* Protect Page
+* * The policies' protect callback, the next access to the page faults
+*/
+static void protectPage(MMContext *ctx, Page *page) {
+    if (!(page->flags & PTE_MAPPED)) return;
+    pteClear(page, PTE_MAPPED | PTE_WRITABLE);
+    result.protections++;
+}
+
+/**
+* Track Fault
+* * Records a fault and revokes access to the pages of the earlier faults as trackFault and
+* * faultRetried in 473_mm.c do. A fault at an address, then at the start of a page less
+* * than an access away, then at that address again, is a retried access to both pages.
+* @param page the page the fault was taken on
+* @param addr the faulting address, from the start of the region
+*/
+static void trackFault(Page *page, long addr) {
+    long low = addr < lastAddr ? addr : lastAddr;
+    long high = addr < lastAddr ? lastAddr : addr;
+    bool retried = addr == prevAddr && high > low && high - low < MAX_ACCESS && high % pageSize == 0;
+    prevAddr = lastAddr;
+    lastAddr = addr;
+    if (!mmPolicyOps->trackReferences) return;
+    for (int i = retried ? 1 : 0; i < 2; i++) {
+        if (tracked[i] != NULL && tracked[i] != page && (tracked[i]->flags & PTE_PRESENT)) {
+            pteClear(tracked[i], PTE_REF);
+            protectPage(&mmContext, tracked[i]);
+        }
+    }
+    tracked[1] = retried && tracked[0] != page ? tracked[0] : NULL;
+    tracked[0] = page;
+}
+
+/**
+* Simulate Access
+* * Replays one access. It faults if the page's protection does not allow it, and the
+* * fault is handled as handleFault in 473_mm.c handles it, with the pager's defaults.
+* @param i the access in the trace
+*/
+static void simulateAccess(long i) {
+    Page *page = &pageTable[trace.pages[i]];
+    bool write = trace.writes[i];
+    if (page->flags & (write ? PTE_WRITABLE : PTE_MAPPED)) return;
+    mmContext.now++;
+    long addr = (long)trace.pages[i] * pageSize + trace.offsets[i] * (long)sizeof(int);
+
+    simFaultType cause;
+    int evictedPage = -1;
+    bool writeBack = false;
+    if (page->pageFrame == -1) {
+        // Page not present, evict the policy's victim once every frame is full
+        if (!write) {
+            cause = ReadNPP;
+            pteSet(page, PTE_READONLY | PTE_REF);
+        } else {
+            cause = WriteNPP;
+            pteSet(page, PTE_REF);
+            setWrite(page, 3);
+        }
+        int frame;
+        if (activePages < mmContext.nFrames) {
+            frame = activePages++;
+        } else {
+            frame = mmPolicyOps->selectVictim(&mmContext, page);
+            Page *oldPage = frameTable[frame].page;
+            evictedPage = oldPage - pageTable;
+            writeBack = (getWrite(oldPage) & 1) > 0;
+            if (writeBack) result.writeBacks++;
+            oldPage->pageFrame = -1;
+            pteClear(oldPage, ~(PTE_READONLY | PTE_QUEUED | PTE_SWAPPED));
+        }
+        page->pageFrame = frame;
+        pteSet(page, PTE_PRESENT);
+        frameTable[frame].page = page;
+        grant(page, write);
+        mmPolicyOps->onFault(&mmContext, page);
+        trackFault(page, addr);
+        result.misses++;
+    } else {
+        // Page present, the fault only samples the reference
+        if ((page->flags & PTE_READONLY) && write) {
+            cause = WriteRO;
+            pteClear(page, PTE_READONLY);
+        } else {
+            cause = write ? WriteRW : ReadRW;
+        }
+        pteSet(page, PTE_REF);
+        if (write) setWrite(page, 3);
+        grant(page, write);
+        if (mmPolicyOps->onReference != NULL) {
+            mmPolicyOps->onReference(&mmContext, page, write);
+            trackFault(page, addr);
+        }
+    }
+
+    result.faults[cause]++;
+    if (logFaults) {
+        printf("%d\t\t%d\t\t%d\t\t%d\t\t0x%04x\n", cause, trace.pages[i], evictedPage, writeBack,
+               page->pageFrame * pageSize + trace.offsets[i] * (int)sizeof(int));
+    }
+}
+
+/**
+* Simulate
+* * Replays the whole trace through a policy with a fresh page table and frame table
+* @param policy the policy number, 1 to 7
+* @param nFrames the number of frames
+*/
+static void simulate(int policy, int nFrames) {
+    memset(&result, 0, sizeof(result));
+    pageTable = calloc(trace.nPages, sizeof(Page));
+    frameTable = calloc(nFrames, sizeof(Frame));
+    if (pageTable == NULL || frameTable == NULL) exit(-1);
+    for (int i = 0; i < trace.nPages; i++) pageTable[i].pageFrame = -1;
+    activePages = 0;
+    lastAddr = prevAddr = -1;
+    tracked[0] = tracked[1] = NULL;
+
+    mmPolicyOps = mm_get_policy(policy);
+    memset(&mmContext, 0, sizeof(mmContext));
+    mmContext.pageTable = pageTable;
+    mmContext.nPages = trace.nPages;
+    mmContext.frameTable = frameTable;
+    mmContext.nFrames = nFrames;
+    mmContext.readCost = readCost;
+    mmContext.writeCost = writeCost;
+    mmContext.protect = protectPage;
+    mmPolicyOps->init(&mmContext);
+
+    for (long i = 0; i < trace.length; i++) simulateAccess(i);
+
+    free(mmContext.state);
+    free(pageTable);
+    free(frameTable);
+}
+
+/**
+* Next Uses
+* * Builds the next-use index, the position of the next access to the same page for every
+* * access, trace.length if there is none
+*/
+static long *nextUses() {
+    long *next = malloc(trace.length * sizeof(long));
+    long *seen = malloc(trace.nPages * sizeof(long));
+    if (next == NULL || seen == NULL) exit(-1);
+    for (int i = 0; i < trace.nPages; i++) seen[i] = trace.length;
+    for (long i = trace.length - 1; i >= 0; i--) {
+        next[i] = seen[trace.pages[i]];
+        seen[trace.pages[i]] = i;
+    }
+    free(seen);
+    return next;
+}
+
+/**
+* Simulate OPT
+* * Belady's OPT evicts the present page whose next access is furthest away. Present pages
+* * are kept in a max heap on their next use; a hit pushes the page again with its new next
+* * use, and entries older than a page's current next use are skipped when popped.
+* @param next the next-use index
+* @param nFrames the number of frames
+*/
+static void simulateOpt(const long *next, int nFrames) {
+    memset(&result, 0, sizeof(result));
+    long *heap = malloc((trace.length + 1) * sizeof(long));
+    long *pending = malloc(trace.nPages * sizeof(long));
+    char *dirty = calloc(trace.nPages, 1);
+    if (heap == NULL || pending == NULL || dirty == NULL) exit(-1);
+    for (int i = 0; i < trace.nPages; i++) pending[i] = -1;
+    long heapLength = 0;
+    int present = 0;
+
+    for (long i = 0; i < trace.length; i++) {
+        int page = trace.pages[i];
+        if (pending[page] == -1) {
+            result.misses++;
+            result.faults[trace.writes[i] ? WriteNPP : ReadNPP]++;
+            if (present == nFrames) {
+                // Pop until an entry is the current next use of a present page
+                while (true) {
+                    long top = heap[0];
+                    heap[0] = heap[--heapLength];
+                    for (long at = 0; 2 * at + 1 < heapLength;) {
+                        long child = 2 * at + 1;
+                        if (child + 1 < heapLength && heap[child + 1] > heap[child]) child++;
+                        if (heap[child] <= heap[at]) break;
+                        long swap = heap[child];
+                        heap[child] = heap[at];
+                        heap[at] = swap;
+                        at = child;
+                    }
+                    // Entries past the end of the trace stand for pages never used again
+                    int victim = top < trace.length ? trace.pages[top] : top - trace.length;
+                    if (pending[victim] == top) {
+                        if (dirty[victim]) result.writeBacks++;
+                        dirty[victim] = 0;
+                        pending[victim] = -1;
+                        break;
+                    }
+                }
+                present--;
+            }
+            present++;
+        }
+        if (trace.writes[i]) dirty[page] = 1;
+
+        // Never used again gets a distinct position past the end, so entries stay unique
+        pending[page] = next[i] < trace.length ? next[i] : trace.length + page;
+        long at = heapLength++;
+        heap[at] = pending[page];
+        while (at > 0 && heap[(at - 1) / 2] < heap[at]) {
+            long swap = heap[(at - 1) / 2];
+            heap[(at - 1) / 2] = heap[at];
+            heap[at] = swap;
+            at = (at - 1) / 2;
+        }
+    }
+    free(heap);
+    free(pending);
+    free(dirty);
+}
+
+/**
+* Stack Distances
+* * Mattson's stack algorithm for LRU in one pass. The stack distance of an access is the
+* * number of distinct pages referenced since the last access to its page, plus one, so
+* * with n frames LRU misses on exactly the accesses whose distance is above n. A Fenwick
+* * tree over the trace marks the last access to every page, and the marks after a page's
+* * last access count the distinct pages since.
+* @param histogram set to the number of accesses at every distance, from 1 to trace.nPages,
+* *                 with first accesses at 0
+*/
+static void stackDistances(unsigned long *histogram) {
+    long *tree = calloc(trace.length + 1, sizeof(long));
+    long *last = malloc(trace.nPages * sizeof(long));
+    if (tree == NULL || last == NULL) exit(-1);
+    for (int i = 0; i < trace.nPages; i++) last[i] = -1;
+
+    for (long i = 0; i < trace.length; i++) {
+        int page = trace.pages[i];
+        if (last[page] == -1) {
+            histogram[0]++;
+        } else {
+            // Marks in (last, i) are the distinct pages referenced since
+            long since = 0;
+            for (long at = i; at > 0; at -= at & -at) since += tree[at];
+            for (long at = last[page] + 1; at > 0; at -= at & -at) since -= tree[at];
+            histogram[since + 1]++;
+            for (long at = last[page] + 1; at <= trace.length; at += at & -at) tree[at]--;
+        }
+        for (long at = i + 1; at <= trace.length; at += at & -at) tree[at]++;
+        last[page] = i;
+    }
+    free(tree);
+    free(last);
+}
+
+static void printResult(const char *name, int nFrames) {
+    printf("policy: %s  frames: %d  accesses: %ld\n", name, nFrames, trace.length);
+    unsigned long faults = 0;
+    for (int i = 0; i < 5; i++) faults += result.faults[i];
+    printf("faults: %lu\n", faults);
+    printf("  ReadNPP: %lu  WriteNPP: %lu  WriteRO: %lu  ReadRW: %lu  WriteRW: %lu\n", result.faults[ReadNPP],
+           result.faults[WriteNPP], result.faults[WriteRO], result.faults[ReadRW], result.faults[WriteRW]);
+    printf("misses: %lu (%.4f per access)\n", result.misses, trace.length ? (double)result.misses / trace.length : 0.0);
+    printf("write backs: %lu\n", result.writeBacks);
+    printf("modeled I/O: %.1f ms\n", ((double)result.misses * readCost + (double)result.writeBacks * writeCost) / 1000);
+    if (result.protections > 0) printf("protection changes: %lu\n", result.protections);
+}
+
+/**
+* Print Curves
+* * Prints the miss ratio of OPT, LRU and every policy at evenly spaced frame counts up to
+* * every page of the trace having a frame
+* @param points number of frame counts
+*/
+static void printCurves(int points) {
+    unsigned long *histogram = calloc(trace.nPages + 1, sizeof(unsigned long));
+    if (histogram == NULL) exit(-1);
+    stackDistances(histogram);
+    long *next = nextUses();
+
+    printf("frames\tOPT\tLRU");
+    for (int policy = 1; policy <= NPOLICIES; policy++) printf("\t%s", mm_get_policy(policy)->name);
+    printf("\n");
+    unsigned long beyond = trace.length - histogram[0];
+    int distance = 0;
+    for (int point = 1; point <= points; point++) {
+        int nFrames = (long)trace.nPages * point / points;
+        if (nFrames < 1) continue;
+        // LRU misses on first accesses and on every access deeper in the stack than the frames
+        while (distance < nFrames) beyond -= histogram[++distance];
+        printf("%d", nFrames);
+        simulateOpt(next, nFrames);
+        printf("\t%.4f", (double)result.misses / trace.length);
+        printf("\t%.4f", (double)(histogram[0] + beyond) / trace.length);
+        for (int policy = 1; policy <= NPOLICIES; policy++) {
+            simulate(policy, nFrames);
+            printf("\t%.4f", (double)result.misses / trace.length);
+        }
+        printf("\n");
+    }
+    free(histogram);
+    free(next);
+}
+
+/**
+* Main Functions
+*/
+
+int main(int argc, char *argv[]) {
+    int opt;
+    int nFrames = 4;
+    int points = 0;
+    while ((opt = getopt(argc, argv, "f:g:lm:w:")) != -1) {
+        switch (opt) {
+            case 'f':
+                nFrames = atoi(optarg);
+                break;
+            case 'g':
+                pageSize = atoi(optarg);
+                break;
+            case 'l':
+                logFaults = true;
+                break;
+            case 'm':
+                points = atoi(optarg);
+                break;
+            case 'w':
+                if (sscanf(optarg, "%d:%d", &readCost, &writeCost) != 2) {
+                    printf("I/O costs must be <read_us>:<write_us>\n");
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if ((points == 0 && argc < 3) || (points != 0 && argc < 2)) {
+        printf("Usage: ./sim [-f <frames>] [-g <page_size>] [-l] [-w <read_us>:<write_us>] <replacement_policy> <input_file>\n");
+        printf("       ./sim -m <points> <input_file>\n");
+        printf("  replacement policy: 0 - OPT, 1 to 7 as for ./out\n");
+        printf("  -f <frames>: number of physical frames (4 by default)\n");
+        printf("  -g <page_size>: page size in bytes, for the physical addresses of the log\n");
+        printf("  -l: print the fault log as ./out does\n");
+        printf("  -w <read_us>:<write_us>: modeled cost of reading a page in and of writing a dirty page back, 100:300 by default\n");
+        printf("  -m <points>: print miss ratio curves of OPT, LRU and every policy at this many frame counts\n");
+        return -1;
+    }
+    if (nFrames < 1 || pageSize < 1 || points < 0 || readCost < 1 || writeCost < 0) {
+        printf("Invalid parameters\n");
+        return -1;
+    }
+    if (loadTrace(argv[points == 0 ? 2 : 1]) != 0) {
+        printf("Invalid input file specified: %s\n", argv[points == 0 ? 2 : 1]);
+        return -1;
+    }
+
+    if (points > 0) {
+        printCurves(points);
+        return 0;
+    }
+    int policy = atoi(argv[1]);
+    if (policy < 0 || policy > NPOLICIES) {
+        printf("Unknown replacement policy specified\n");
+        return -1;
+    }
+    if (logFaults) {
+        printf("Page Size: %d\n", pageSize);
+        printf("Num Frames: %d\n", nFrames);
+        printf("type\tvirt-page\tevicted-virt-page\twrite-back\tphy-addr\n");
+    }
+    if (policy == 0) {
+        long *next = nextUses();
+        simulateOpt(next, nFrames);
+        free(next);
+        if (!logFaults) printResult("OPT", nFrames);
+    } else {
+        simulate(policy, nFrames);
+        if (!logFaults) printResult(mm_get_policy(policy)->name, nFrames);
+    }
+    return 0;
+}
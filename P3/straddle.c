@@ -0,0 +1,93 @@
+// straddle.c
+// Description: Has several threads store and load 8 bytes across every page boundary of their
+//              own pages, checking the values read back, so that each access faults on two pages
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "473_mm.h"
+
+#define  PAGES_PER_THREAD   8
+#define  FRAMES_PER_THREAD  4
+#define  ROUNDS             50
+
+// An 8 byte value at any address, accessed with one unaligned instruction
+typedef uint64_t Unaligned64 __attribute__((aligned(1)));
+
+static int pageSize;
+static char *vm;
+static pthread_barrier_t start;
+static volatile int failed = 0;
+
+void mm_logger(int virt_page, int fault_type, int evicted_page, int write_back, unsigned int phy_addr)
+{
+}
+
+void print_stats()
+{
+}
+
+static void *work(void *arg)
+{
+  long id = (long)arg;
+  char *pages = vm + (size_t)id * PAGES_PER_THREAD * pageSize;
+  pthread_barrier_wait(&start);
+  for (int round = 0; round < ROUNDS && !failed; round++) {
+    for (int page = 1; page < PAGES_PER_THREAD; page++) {
+      volatile Unaligned64 *value = (Unaligned64 *)(pages + page * pageSize - 4);
+      uint64_t expected = ((uint64_t)id << 48) | ((uint64_t)round << 16) | page;
+      *value = expected;
+      if (*value != expected) {
+        printf("thread %ld read back a wrong value across page %d\n", id, page);
+        failed = 1;
+      }
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  int engine = 0;
+  while ((opt = getopt(argc, argv, "u")) != -1) {
+    switch (opt) {
+      case 'u':
+        engine = 1;
+        break;
+      default:
+        return -1;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if (argc < 3) {
+    printf("Usage: ./straddle [-u] <replacement_policy> <threads>\n");
+    return -1;
+  }
+  int policy = atoi(argv[1]);
+  int threads = atoi(argv[2]);
+  if (policy < 1 || policy > 7 || threads < 1) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+  pageSize = sysconf(_SC_PAGE_SIZE);
+
+  int pages = threads * PAGES_PER_THREAD;
+  if (posix_memalign((void *)&vm, pageSize, (size_t)pages * pageSize)) return -1;
+  memset(vm, 0, (size_t)pages * pageSize);
+  if (engine) mm_set_userfaultfd();
+  mm_init(vm, pages * pageSize, threads * FRAMES_PER_THREAD, pageSize, policy);
+
+  // Every thread starts at once, so their faults interleave
+  pthread_t *ids = calloc(threads, sizeof(pthread_t));
+  pthread_barrier_init(&start, NULL, threads);
+  for (long i = 0; i < threads; i++) pthread_create(&ids[i], NULL, work, (void *)i);
+  for (int i = 0; i < threads; i++) pthread_join(ids[i], NULL);
+  return failed ? -1 : 0;
+}
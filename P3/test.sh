@@ -1,5 +1,8 @@
 make
-for alg in 1 2
+make sim
+make decode
+make straddle
+for alg in 1 2 3 4 5 6 7
 do
   for test in 1 2 3 4 5 6 7
   do
@@ -7,3 +10,28 @@ do
     diff ./TestOutputs/$alg/input$test.out  <(./out $alg ./TestInputs/input$test)
   done
 done
+for alg in 1 2 3 4 5 6 7
+do
+  for test in 1 2 3 4 5 6 7
+  do
+    echo "Simulator Replacement Algorithm:" $alg " Test: " $test
+    diff ./TestOutputs/$alg/input$test.out  <(./sim -l $alg ./TestInputs/input$test)
+  done
+done
+for alg in 1 2 3 4 5 6 7
+do
+  for test in 1 2 3 4 5 6 7
+  do
+    echo "Binary Log Replacement Algorithm:" $alg " Test: " $test
+    diff ./TestOutputs/$alg/input$test.out  <(./out -b ./test.log $alg ./TestInputs/input$test && ./decode ./test.log)
+  done
+done
+rm -f ./test.log
+for alg in 5 6 7
+do
+  for engine in "" -u
+  do
+    echo "Straddling Access Replacement Algorithm:" $alg $engine
+    diff <(echo 0) <(timeout 20 ./straddle $engine $alg 2; echo $?)
+  done
+done